@@ -0,0 +1,217 @@
+/*
+ * ActiveObject.h:
+ *	Event queue and run to completion dispatcher for a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+// EventQueue is a bounded multi-producer/single-consumer ring of
+// events.  Any number of threads may Post() while one consumer
+// thread calls TryTake().  Posting is wait-free: a producer first
+// reserves room with one atomic decrement of the free slot count
+// and then claims its slot with one atomic increment of the tail,
+// so it never loops on other producers.  When the ring is full the
+// event is rejected, Post() returns false and the overflow count
+// is incremented so back pressure can be observed by the caller.
+template <typename Event, int capacity>
+class EventQueue
+{
+	static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "EventQueue capacity must be a power of two");
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> Sequence;
+		Event Value;
+	};
+
+	alignas(64) std::atomic<long> _free;
+	alignas(64) std::atomic<size_t> _tail;
+	alignas(64) size_t _head;
+	alignas(64) std::atomic<size_t> _overflows;
+	Slot _slots[capacity];
+
+public:
+	EventQueue() :
+		_free(capacity),
+		_tail(0),
+		_head(0),
+		_overflows(0)
+	{
+		for (int i = 0; i < capacity; i++)
+		{
+			_slots[i].Sequence.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	EventQueue(const EventQueue&) = delete;
+	EventQueue& operator=(const EventQueue&) = delete;
+
+	bool Post(const Event& event)
+	{
+		if (_free.fetch_sub(1, std::memory_order_acquire) <= 0)
+		{
+			_free.fetch_add(1, std::memory_order_relaxed);
+			_overflows.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// At most capacity events are reserved and not yet taken, so
+		// the slot of this position has already been consumed.
+		size_t position = _tail.fetch_add(1, std::memory_order_relaxed);
+		Slot& slot = _slots[position & (capacity - 1)];
+
+		slot.Value = event;
+		slot.Sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only.
+	bool TryTake(Event& event)
+	{
+		Slot& slot = _slots[_head & (capacity - 1)];
+
+		if (slot.Sequence.load(std::memory_order_acquire) != _head + 1)
+		{
+			return false;
+		}
+
+		event = slot.Value;
+		_head++;
+		_free.fetch_add(1, std::memory_order_release);
+		return true;
+	}
+
+	// Approximate when called while producers are posting.
+	size_t GetCount() const
+	{
+		long count = capacity - _free.load(std::memory_order_relaxed);
+		return count < 0 ? 0 : (size_t)count;
+	}
+
+	size_t GetOverflowCount() const { return _overflows.load(std::memory_order_relaxed); }
+
+	static constexpr int GetCapacity() { return capacity; }
+};
+
+// ActiveObject wraps a top-level state machine such as an OrState
+// with an EventQueue.  Producers on any thread Post() events and a
+// single consumer thread, started with Start(), drains the queue
+// and hands each event to Machine::Trigger in the order it was
+// posted.  Every trigger runs to completion before the next one is
+// taken, so the machine itself needs no locking.  Dispatch() drains
+// the queue on the calling thread instead and must not be used while
+// the consumer thread is running.
+template <class Machine, typename Event, int capacity>
+class ActiveObject
+{
+private:
+	Machine& _machine;
+	EventQueue<Event, capacity> _queue;
+	std::atomic<bool> _running;
+	std::atomic<size_t> _dispatched;
+	std::thread _consumer;
+
+	void Run()
+	{
+		int idle = 0;
+
+		while (_running.load(std::memory_order_acquire))
+		{
+			if (Dispatch() != 0)
+			{
+				idle = 0;
+			}
+			else if (++idle < 64)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}
+
+		// Drain whatever was posted before Stop().
+		Dispatch();
+	}
+
+public:
+	ActiveObject(Machine& machine) :
+		_machine(machine),
+		_running(false),
+		_dispatched(0)
+	{
+	}
+
+	~ActiveObject()
+	{
+		Stop();
+	}
+
+	void Start()
+	{
+		if (_running.exchange(true))
+		{
+			return;
+		}
+		_consumer = std::thread(&ActiveObject::Run, this);
+	}
+
+	void Stop()
+	{
+		if (!_running.exchange(false))
+		{
+			return;
+		}
+		_consumer.join();
+	}
+
+	bool Post(const Event& event)
+	{
+		return _queue.Post(event);
+	}
+
+	size_t Dispatch()
+	{
+		size_t count = 0;
+		Event event;
+
+		while (_queue.TryTake(event))
+		{
+			_machine.Trigger(event);
+			count++;
+		}
+
+		_dispatched.fetch_add(count, std::memory_order_relaxed);
+		return count;
+	}
+
+	size_t GetPendingCount() const { return _queue.GetCount(); }
+
+	size_t GetOverflowCount() const { return _queue.GetOverflowCount(); }
+
+	size_t GetDispatchedCount() const { return _dispatched.load(std::memory_order_relaxed); }
+};
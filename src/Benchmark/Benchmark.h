@@ -0,0 +1,236 @@
+/*
+ * Benchmark.h:
+ *	Minimal microbenchmark harness for a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// A small stand alone harness in the style of Google Benchmark.  A
+// benchmark is a function taking a BenchmarkState and running the
+// measured code once per iteration of a range based for loop over
+// the state.  Code before the loop is setup and is not timed:
+//
+// void YourBenchmark(BenchmarkState& state)
+// {
+//	YourStateMachine sm;
+//	sm.Trigger(TRIGGERS::DEFAULTENTRY);
+//
+//	for (auto _ : state)
+//	{
+//		sm.Trigger(TRIGGERS::YOURTRIGGER1);
+//	}
+// }
+//
+// The iteration count grows until one run lasts at least the
+// minimum time.  Heap allocations made while the loop runs are
+// counted through the global operator new, which the benchmark
+// executable replaces to update the counters below.
+
+inline std::atomic<size_t> BenchmarkAllocationCount(0);
+inline std::atomic<size_t> BenchmarkAllocationBytes(0);
+
+template <typename T>
+inline void DoNotOptimize(T const& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+class BenchmarkState
+{
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	size_t _iterations;
+	Clock::time_point _start;
+	double _seconds = 0;
+	size_t _allocations = 0;
+	size_t _allocatedBytes = 0;
+
+	void Start()
+	{
+		_allocations = BenchmarkAllocationCount.load(std::memory_order_relaxed);
+		_allocatedBytes = BenchmarkAllocationBytes.load(std::memory_order_relaxed);
+		_start = Clock::now();
+	}
+
+	void Stop()
+	{
+		Clock::time_point stop = Clock::now();
+
+		_seconds = std::chrono::duration<double>(stop - _start).count();
+		_allocations = BenchmarkAllocationCount.load(std::memory_order_relaxed) - _allocations;
+		_allocatedBytes = BenchmarkAllocationBytes.load(std::memory_order_relaxed) - _allocatedBytes;
+	}
+
+public:
+	// The loop variable has a user provided destructor so that an
+	// unused "_" does not cause a warning.
+	struct Value
+	{
+		Value() {}
+		~Value() {}
+	};
+
+	class Iterator
+	{
+	private:
+		BenchmarkState* _state;
+		size_t _remaining;
+
+	public:
+		Iterator(BenchmarkState* state, size_t remaining) :
+			_state(state),
+			_remaining(remaining)
+		{
+		}
+
+		Value operator*() const { return Value(); }
+		void operator++() { _remaining--; }
+
+		bool operator!=(const Iterator&)
+		{
+			if (_remaining != 0)
+			{
+				return true;
+			}
+
+			_state->Stop();
+			return false;
+		}
+	};
+
+	BenchmarkState(size_t iterations) :
+		_iterations(iterations)
+	{
+	}
+
+	Iterator begin()
+	{
+		Start();
+		return Iterator(this, _iterations);
+	}
+
+	Iterator end() { return Iterator(this, 0); }
+
+	size_t GetIterations() const { return _iterations; }
+	double GetSeconds() const { return _seconds; }
+	size_t GetAllocations() const { return _allocations; }
+	size_t GetAllocatedBytes() const { return _allocatedBytes; }
+};
+
+class BenchmarkRunner
+{
+private:
+	typedef void (*Function)(BenchmarkState&);
+
+	struct Entry
+	{
+		const char* Name;
+		Function Run;
+	};
+
+	std::vector<Entry> _benchmarks;
+
+public:
+	void Add(const char* name, Function function)
+	{
+		_benchmarks.push_back({ name, function });
+	}
+
+	// Runs every benchmark whose name contains filter and writes the
+	// results to json in the layout of Google Benchmark's JSON
+	// reporter.  A one line summary per benchmark goes to log.
+	void Run(FILE* json, FILE* log, const char* filter, double minSeconds)
+	{
+		fprintf(json, "{\n");
+		fprintf(json, "  \"context\": {\n");
+		fprintf(json, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+		fprintf(json, "    \"library_build_type\": \"release\"\n");
+#else
+		fprintf(json, "    \"library_build_type\": \"debug\"\n");
+#endif
+		fprintf(json, "  },\n");
+		fprintf(json, "  \"benchmarks\": [");
+
+		bool first = true;
+
+		for (const Entry& benchmark : _benchmarks)
+		{
+			if (filter != nullptr && strstr(benchmark.Name, filter) == nullptr)
+			{
+				continue;
+			}
+
+			size_t iterations = 1;
+
+			while (true)
+			{
+				BenchmarkState state(iterations);
+				benchmark.Run(state);
+
+				if (state.GetSeconds() >= minSeconds || iterations >= 1000000000)
+				{
+					double perIteration = (double)state.GetIterations();
+					double ns = state.GetSeconds() * 1e9 / perIteration;
+
+					fprintf(json, "%s\n    {\n", first ? "" : ",");
+					fprintf(json, "      \"name\": \"%s\",\n", benchmark.Name);
+					fprintf(json, "      \"run_type\": \"iteration\",\n");
+					fprintf(json, "      \"iterations\": %zu,\n", state.GetIterations());
+					fprintf(json, "      \"real_time\": %.3f,\n", ns);
+					fprintf(json, "      \"time_unit\": \"ns\",\n");
+					fprintf(json, "      \"allocations\": %.3f,\n", state.GetAllocations() / perIteration);
+					fprintf(json, "      \"allocated_bytes\": %.3f\n", state.GetAllocatedBytes() / perIteration);
+					fprintf(json, "    }");
+					first = false;
+
+					fprintf(log, "%-40s %12.1f ns %10zu iterations %8.1f bytes allocated\n",
+						benchmark.Name,
+						ns,
+						state.GetIterations(),
+						state.GetAllocatedBytes() / perIteration);
+					break;
+				}
+
+				// Aim past the minimum time from the last run, growing
+				// by at most a factor of ten.
+				double scale = state.GetSeconds() > 0 ? minSeconds * 1.4 / state.GetSeconds() : 10.0;
+				size_t next = (size_t)(iterations * (scale < 10.0 ? scale : 10.0));
+				iterations = next > iterations ? next : iterations + 1;
+			}
+		}
+
+		fprintf(json, "\n  ]\n}\n");
+	}
+};
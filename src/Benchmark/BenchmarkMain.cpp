@@ -0,0 +1,459 @@
+/*
+ * BenchmarkMain.cpp:
+ *	Microbenchmarks for a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+
+#include <cstdlib>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include "Benchmark.h"
+#include "../RegionWorkerPool.h"
+#include "../SimpleStateMachine/SimpleStateMachine.h"
+#include "../KeyboardStateMachine/KeyBoardStateMachine.h"
+#include "../KeyboardStateMachine/KeyboardFlatStateMachine.h"
+#include "../KeyboardStateMachine/KeyboardTracedStateMachine.h"
+#include "../KeyboardStateMachine/KeyboardProfiledStateMachine.h"
+#include "../KeyboardStateMachine/KeyboardPairStateMachine.h"
+#include "../KeyboardStateMachine/KeyboardTimedStateMachine.h"
+#include "../KeyboardStateMachineExtended/KeyboardStateModel.h"
+#include "../KeyboardStateMachineExtended/KeyBoardStateMachineExtended.h"
+#include "../SStateMachine/s.h"
+#include "../SStateMachine/SFlat.h"
+
+// Every heap allocation of the benchmark executable is counted so
+// that the construction benchmarks report the memory per instance.
+// All the replaceable scalar and array forms go through the two
+// functions below, which are kept out of line so the compiler never
+// pairs a new expression with the free() call inside them.
+#if defined(_MSC_VER)
+#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+static BENCHMARK_NOINLINE void* CountedAllocate(size_t size) noexcept
+{
+	BenchmarkAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	BenchmarkAllocationBytes.fetch_add(size, std::memory_order_relaxed);
+
+	return malloc(size != 0 ? size : 1);
+}
+
+static BENCHMARK_NOINLINE void CountedFree(void* memory) noexcept
+{
+	free(memory);
+}
+
+void* operator new(size_t size)
+{
+	void* memory = CountedAllocate(size);
+	if (memory == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	CountedFree(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	CountedFree(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	CountedFree(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	CountedFree(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	CountedFree(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	CountedFree(memory);
+}
+
+void SimpleConstructDestroy(BenchmarkState& state)
+{
+	for (auto _ : state)
+	{
+		SimpleStateMachine* sm = new SimpleStateMachine();
+		DoNotOptimize(sm);
+		delete sm;
+	}
+}
+
+void SimpleSelfTransition(BenchmarkState& state)
+{
+	SimpleStateMachine sm;
+	sm.Trigger(TRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(TRIGGERS::IDLETRIGGER));
+	}
+}
+
+void SimpleNoGuard(BenchmarkState& state)
+{
+	SimpleStateMachine sm;
+	sm.Trigger(TRIGGERS::DEFAULTENTRY);
+	sm.Trigger(TRIGGERS::FINALTRIGGER);
+
+	// FINAL has no guard for FINALTRIGGER.
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(TRIGGERS::FINALTRIGGER));
+	}
+}
+
+void KeyboardConstructDestroy(BenchmarkState& state)
+{
+	for (auto _ : state)
+	{
+		KeyboardStateMachine* sm = new KeyboardStateMachine();
+		DoNotOptimize(sm);
+		delete sm;
+	}
+}
+
+void KeyboardSelfTransition(BenchmarkState& state)
+{
+	KeyboardStateMachine sm;
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::ANYKEY));
+	}
+}
+
+// No state of the machine handles TIMEOUT.
+void KeyboardIgnored(BenchmarkState& state)
+{
+	KeyboardStateMachine sm;
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT));
+	}
+}
+
+void KeyboardPairBroadcast(BenchmarkState& state)
+{
+	KeyboardPairStateMachine sm;
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::ANYKEY));
+	}
+}
+
+void KeyboardPairParallelBroadcast(BenchmarkState& state)
+{
+	RegionWorkerPool pool(1);
+	KeyboardPairStateMachine sm;
+	sm.SetDispatcher(&pool);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::ANYKEY));
+	}
+}
+
+void KeyboardTimedSelfTransition(BenchmarkState& state)
+{
+	KeyboardTimerWheel wheel;
+	KeyboardTimedStateMachine sm(wheel, 500);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+
+	// Every key cancels the pending timeout and arms a new one.
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::ANYKEY));
+	}
+}
+
+void KeyboardFlatSelfTransition(BenchmarkState& state)
+{
+	KeyboardFlatStateMachine sm;
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::ANYKEY));
+	}
+}
+
+void KeyboardTracedSelfTransition(BenchmarkState& state, bool enabled)
+{
+	KeyboardTracedStateMachine sm;
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	RingTracePolicy<>::Enable(enabled);
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::ANYKEY));
+	}
+	RingTracePolicy<>::Enable(false);
+}
+
+void KeyboardTracedSelfTransitionDisabled(BenchmarkState& state)
+{
+	KeyboardTracedSelfTransition(state, false);
+}
+
+void KeyboardTracedSelfTransitionEnabled(BenchmarkState& state)
+{
+	KeyboardTracedSelfTransition(state, true);
+}
+
+void KeyboardProfiledSelfTransition(BenchmarkState& state)
+{
+	KeyboardProfiledStateMachine sm;
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERS::ANYKEY));
+	}
+}
+
+void KeyboardExtendedConstructDestroy(BenchmarkState& state)
+{
+	KeyboardStateModel stateModel;
+
+	for (auto _ : state)
+	{
+		KeyboardStateMachineExtended* sm = new KeyboardStateMachineExtended(stateModel);
+		DoNotOptimize(sm);
+		delete sm;
+	}
+}
+
+void KeyboardExtendedSelfTransition(BenchmarkState& state)
+{
+	KeyboardStateModel stateModel;
+	stateModel.SetKeyCount((int)state.GetIterations() + 1);
+
+	KeyboardStateMachineExtended sm(stateModel);
+	sm.Trigger(KEYBOARDTRIGGERSExtended::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(KEYBOARDTRIGGERSExtended::ANYKEY));
+	}
+}
+
+void SConstructDestroy(BenchmarkState& state)
+{
+	for (auto _ : state)
+	{
+		S* sm = new S();
+		DoNotOptimize(sm);
+		delete sm;
+	}
+}
+
+void SNoGuard(BenchmarkState& state)
+{
+	S sm;
+	sm.Trigger(STRIGGERS::DEFAULTENTRY);
+	sm.Trigger(STRIGGERS::T);
+
+	// Neither S21, S2 nor S has a guard for T.
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(STRIGGERS::T));
+	}
+}
+
+void SReset(BenchmarkState& state)
+{
+	S sm;
+	sm.Trigger(STRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		sm.Trigger(STRIGGERS::DEFAULTEXIT);
+		DoNotOptimize(sm.Trigger(STRIGGERS::DEFAULTENTRY));
+	}
+}
+
+// S11 -> S21 on T.  Each iteration also resets the machine to S11,
+// the cost of which is measured on its own by SReset.
+void SCrossHierarchy(BenchmarkState& state)
+{
+	S sm;
+	sm.Trigger(STRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(STRIGGERS::T));
+		sm.Trigger(STRIGGERS::DEFAULTEXIT);
+		sm.Trigger(STRIGGERS::DEFAULTENTRY);
+	}
+}
+
+void SFlatCrossHierarchy(BenchmarkState& state)
+{
+	SFlat sm;
+	sm.Trigger(STRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(STRIGGERS::T));
+		sm.Trigger(STRIGGERS::DEFAULTEXIT);
+		sm.Trigger(STRIGGERS::DEFAULTENTRY);
+	}
+}
+
+// Replay mode skips the output of the actions, which otherwise
+// dominates the cost of the transition.
+void SCrossHierarchyQuiet(BenchmarkState& state)
+{
+	S sm;
+	sm.SetReplayMode(true);
+	sm.Trigger(STRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(STRIGGERS::T));
+		sm.Trigger(STRIGGERS::DEFAULTEXIT);
+		sm.Trigger(STRIGGERS::DEFAULTENTRY);
+	}
+}
+
+void SFlatCrossHierarchyQuiet(BenchmarkState& state)
+{
+	SFlat sm;
+	sm.SetReplayMode(true);
+	sm.Trigger(STRIGGERS::DEFAULTENTRY);
+
+	for (auto _ : state)
+	{
+		DoNotOptimize(sm.Trigger(STRIGGERS::T));
+		sm.Trigger(STRIGGERS::DEFAULTEXIT);
+		sm.Trigger(STRIGGERS::DEFAULTENTRY);
+	}
+}
+
+// Usage: benchmark [--benchmark_out=<file>] [--benchmark_filter=<text>]
+//	[--benchmark_min_time=<seconds>]
+// The JSON results go to the output file, benchmark.json by default,
+// and a summary goes to stderr.  The example machines print their
+// actions, so stdout is discarded while the benchmarks run.
+int main(int argc, char* argv[])
+{
+	const char* outputPath = "benchmark.json";
+	const char* filter = nullptr;
+	double minSeconds = 0.5;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--benchmark_out=", 16) == 0)
+		{
+			outputPath = argv[i] + 16;
+		}
+		else if (strncmp(argv[i], "--benchmark_filter=", 19) == 0)
+		{
+			filter = argv[i] + 19;
+		}
+		else if (strncmp(argv[i], "--benchmark_min_time=", 21) == 0)
+		{
+			minSeconds = atof(argv[i] + 21);
+		}
+	}
+
+	FILE* json = fopen(outputPath, "w");
+	if (json == nullptr)
+	{
+		fprintf(stderr, "Cannot open %s\n", outputPath);
+		return 1;
+	}
+
+#ifdef _WIN32
+	freopen("NUL", "w", stdout);
+#else
+	freopen("/dev/null", "w", stdout);
+#endif
+
+	BenchmarkRunner runner;
+
+	runner.Add("Simple/ConstructDestroy", SimpleConstructDestroy);
+	runner.Add("Simple/SelfTransition", SimpleSelfTransition);
+	runner.Add("Simple/NoGuard", SimpleNoGuard);
+	runner.Add("Keyboard/ConstructDestroy", KeyboardConstructDestroy);
+	runner.Add("Keyboard/SelfTransition", KeyboardSelfTransition);
+	runner.Add("Keyboard/Ignored", KeyboardIgnored);
+	runner.Add("KeyboardPair/Broadcast", KeyboardPairBroadcast);
+	runner.Add("KeyboardPair/ParallelBroadcast", KeyboardPairParallelBroadcast);
+	runner.Add("KeyboardTimed/SelfTransition", KeyboardTimedSelfTransition);
+	runner.Add("KeyboardFlat/SelfTransition", KeyboardFlatSelfTransition);
+	runner.Add("KeyboardTraced/SelfTransitionDisabled", KeyboardTracedSelfTransitionDisabled);
+	runner.Add("KeyboardTraced/SelfTransitionEnabled", KeyboardTracedSelfTransitionEnabled);
+	runner.Add("KeyboardProfiled/SelfTransition", KeyboardProfiledSelfTransition);
+	runner.Add("KeyboardExtended/ConstructDestroy", KeyboardExtendedConstructDestroy);
+	runner.Add("KeyboardExtended/SelfTransition", KeyboardExtendedSelfTransition);
+	runner.Add("S/ConstructDestroy", SConstructDestroy);
+	runner.Add("S/NoGuard", SNoGuard);
+	runner.Add("S/Reset", SReset);
+	runner.Add("S/CrossHierarchy", SCrossHierarchy);
+	runner.Add("SFlat/CrossHierarchy", SFlatCrossHierarchy);
+	runner.Add("S/CrossHierarchyQuiet", SCrossHierarchyQuiet);
+	runner.Add("SFlat/CrossHierarchyQuiet", SFlatCrossHierarchyQuiet);
+
+	runner.Run(json, stderr, filter, minSeconds);
+
+	fclose(json);
+	return 0;
+}
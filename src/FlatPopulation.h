@@ -0,0 +1,235 @@
+/*
+ * FlatPopulation.h:
+ *	Structure of arrays population of flat C++ UML state machines.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "FlatStateMachine.h"
+
+// FlatPopulation steps a large number of instances of one flat
+// machine type that has no guards and no entry or exit actions, so
+// that every transition depends only on the current state and the
+// trigger.  Only the active leaf state of each instance is stored,
+// in one packed array, and each trigger is applied to the whole
+// population with a single table lookup per instance:
+//
+// FlatPopulation<YourMachine> population(1000000);
+// population.Trigger(TRIGGERS::DEFAULTENTRY);
+// population.Trigger(TRIGGERS::YOURTRIGGER1);
+//
+// The lookup table holds the resulting leaf state for every (state,
+// trigger) pair, including NOSTATE and the DEFAULTENTRY/DEFAULTEXIT
+// triggers, so the loop has no branches.  When compiled for AVX2
+// eight instances are stepped per gather instruction.
+template <class Machine>
+class FlatPopulation
+{
+private:
+	typedef typename Machine::TriggerType EnumTrigger;
+	typedef typename Machine::StateType EnumState;
+
+	static constexpr int numTriggers = Machine::TriggerCount;
+	static constexpr int numStates = Machine::StateCount;
+
+	// States are stored offset by one so that NOSTATE is column 0,
+	// and the two reserved triggers are rows 0 and 1.
+	static constexpr int stride = numStates + 1;
+	static constexpr int triggerBias = -RESERVED_TRIGGER_DEFAULT_EXIT;
+
+	struct StepTable
+	{
+		int Next[numTriggers + triggerBias][stride] = {};
+	};
+
+	static constexpr const auto& GetTable()
+	{
+		return Machine::template Table<typename Machine::Definition>;
+	}
+
+	// Column of the leaf the machine ends up in when entering state,
+	// following default entries and triggerless transitions.
+	static constexpr int EnterColumn(int state)
+	{
+		const auto& table = GetTable();
+
+		while (state != RESERVED_NO_STATE)
+		{
+			while (table.DefaultEntry[state] != RESERVED_NO_STATE)
+			{
+				state = table.DefaultEntry[state];
+			}
+			if (table.Triggerless[state] == RESERVED_NO_STATE_CHANGE)
+			{
+				return state + 1;
+			}
+			state = table.Triggerless[state];
+		}
+		return 0;
+	}
+
+	static constexpr bool IsStateless()
+	{
+		const auto& table = GetTable();
+
+		for (int i = 0; i < numStates; i++)
+		{
+			if (table.Entry[i] != nullptr || table.Exit[i] != nullptr)
+			{
+				return false;
+			}
+		}
+
+		for (const auto& handler : table.Handlers)
+		{
+			if (handler.Guard != nullptr)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static constexpr StepTable BuildSteps()
+	{
+		const auto& table = GetTable();
+		StepTable steps;
+
+		int entryLeaf = EnterColumn((int)Machine::DefaultEntryState);
+
+		for (int column = 0; column < stride; column++)
+		{
+			steps.Next[RESERVED_TRIGGER_DEFAULT_ENTRY + triggerBias][column] = column == 0 ? entryLeaf : column;
+			steps.Next[RESERVED_TRIGGER_DEFAULT_EXIT + triggerBias][column] = 0;
+		}
+
+		for (int trigger = 0; trigger < numTriggers; trigger++)
+		{
+			steps.Next[trigger + triggerBias][0] = 0;
+
+			for (int state = 0; state < numStates; state++)
+			{
+				int next = state + 1;
+
+				for (int index = table.Dispatch[state][trigger];
+					index != RESERVED_NO_STATE;
+					index = table.Handlers[index].Next)
+				{
+					int target = table.Handlers[index].Target;
+
+					if (target != RESERVED_NO_STATE_CHANGE)
+					{
+						next = EnterColumn(target);
+						break;
+					}
+				}
+
+				steps.Next[trigger + triggerBias][state + 1] = next;
+			}
+		}
+
+		return steps;
+	}
+
+	static_assert(IsStateless(), "FlatPopulation needs a machine without guards or entry and exit actions");
+
+	static constexpr StepTable Steps = BuildSteps();
+
+	std::vector<int> _states;
+
+public:
+	FlatPopulation(size_t count) :
+		_states(count, 0)
+	{
+	}
+
+	size_t GetCount() const { return _states.size(); }
+
+	EnumState GetState(size_t index) const { return (EnumState)(_states[index] - 1); }
+
+	size_t CountInState(EnumState state) const
+	{
+		int column = (int)state + 1;
+		size_t count = 0;
+
+		for (int value : _states)
+		{
+			count += value == column;
+		}
+		return count;
+	}
+
+	// Applies the same trigger to every instance.
+	void Trigger(EnumTrigger trigger)
+	{
+		const int* next = Steps.Next[(int)trigger + triggerBias];
+		int* states = _states.data();
+		size_t count = _states.size();
+		size_t i = 0;
+
+#ifdef __AVX2__
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i state = _mm256_loadu_si256((const __m256i*)(states + i));
+			_mm256_storeu_si256((__m256i*)(states + i), _mm256_i32gather_epi32(next, state, 4));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			states[i] = next[states[i]];
+		}
+	}
+
+	// Applies triggers[i] to instance i, triggers must hold one
+	// trigger per instance.
+	void Trigger(const EnumTrigger* triggers)
+	{
+		static_assert(sizeof(EnumTrigger) == sizeof(int), "Trigger enumeration must be int sized");
+
+		const int* next = &Steps.Next[0][0];
+		int* states = _states.data();
+		size_t count = _states.size();
+		size_t i = 0;
+
+#ifdef __AVX2__
+		const __m256i strideVector = _mm256_set1_epi32(stride);
+		const __m256i biasVector = _mm256_set1_epi32(triggerBias * stride);
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i trigger = _mm256_loadu_si256((const __m256i*)(triggers + i));
+			__m256i state = _mm256_loadu_si256((const __m256i*)(states + i));
+			__m256i index = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(trigger, strideVector), biasVector), state);
+
+			_mm256_storeu_si256((__m256i*)(states + i), _mm256_i32gather_epi32(next, index, 4));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			states[i] = next[((int)triggers[i] + triggerBias) * stride + states[i]];
+		}
+	}
+};
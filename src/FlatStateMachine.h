@@ -0,0 +1,739 @@
+/*
+ * FlatStateMachine.h:
+ *	Compile time flattened transition table for a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include "StateMachine.h"
+
+// The flat state machine is an opt-in alternative to a tree of
+// OrState/StateTemplate objects.  The same hierarchy is described
+// with constexpr tables that live in a nested Definition struct of
+// the machine class:
+//
+// struct YourMachine::Definition
+// {
+//	static constexpr FlatStateDescriptor<YourMachine, STATES> States[] =
+//	{
+//		// Id, Parent, DefaultEntry, Entry, Exit, Triggerless
+//		{ STATES::YOURSTATE1, STATES::NOSTATE, STATES::YOURSTATE11, nullptr, &YourMachine::Exit1 },
+//		...
+//	};
+//
+//	static constexpr FlatTransitionDescriptor<YourMachine, TRIGGERS, STATES> Transitions[] =
+//	{
+//		// Source, Trigger, Guard, Target
+//		{ STATES::YOURSTATE1, TRIGGERS::YOURTRIGGER1, &YourMachine::Trigger1Guard },
+//		{ STATES::YOURSTATE1, TRIGGERS::YOURTRIGGER2, nullptr, STATES::YOURSTATE2 },
+//		...
+//	};
+// };
+//
+// At compile time the hierarchy is flattened into a (leaf state x
+// trigger) table, so a trigger is dispatched with one indexed load
+// followed by the guard call.  The common ancestor of every (source,
+// target) pair and the entry path of every target are precomputed
+// too, so a transition walks flat arrays from the active leaf up to
+// the common ancestor and from there down to the new leaf.  Guards
+// have the same signature and semantics as the guards of a
+// StateTemplate.  If the innermost guard leaves the target state as
+// NOSTATECHANGE the trigger is offered to the next enclosing state
+// that has a guard for it.  A transition without a guard always goes
+// to its Target state.
+//
+// A leaf state may name a Triggerless target that the machine goes
+// to as soon as the state has been entered, or NOSTATE to exit the
+// machine.  For a guarded transition Target may name the state the
+// guard goes to; it is only used by the validation below.
+//
+// The description is validated when the tables are built, so a
+// machine with an undescribed or duplicated state, a composite
+// without a default entry, a transition with neither guard nor
+// target, a loop of triggerless transitions or, when every target is
+// known, an unreachable state does not compile.  None of these need
+// checking at runtime.
+//
+// The tables are built once per machine type and shared by every
+// instance, and the transition being taken lives on the stack of
+// Trigger(), so the only per-instance state of the engine is the
+// active leaf state and the replay mode flag.  Anything else an
+// instance needs, such as a pointer to its own data model, is a
+// member of the derived class.
+
+template <class T, typename EnumState>
+struct FlatStateDescriptor
+{
+	typedef void (T::* Action)();
+
+	EnumState Id;
+	EnumState Parent = EnumState::NOSTATE;
+	EnumState DefaultEntry = EnumState::NOSTATE;
+	Action Entry = nullptr;
+	Action Exit = nullptr;
+	EnumState Triggerless = EnumState::NOSTATECHANGE;
+};
+
+// HasGuard records whether the transition was given a guard.  The
+// validation tests it rather than the member pointer, which some
+// compilers, such as GCC with -fsanitize=undefined, do not compare
+// in a constant expression.
+template <class T, typename EnumTrigger, typename EnumState>
+struct FlatTransitionDescriptor
+{
+	typedef void (T::* TriggerGuard)(EnumTrigger, Transition<T, EnumState>&);
+
+	EnumState Source;
+	EnumTrigger Trigger;
+	TriggerGuard Guard = nullptr;
+	EnumState Target = EnumState::NOSTATECHANGE;
+	bool HasGuard = false;
+
+	constexpr FlatTransitionDescriptor(EnumState source, EnumTrigger trigger,
+		std::nullptr_t = nullptr, EnumState target = EnumState::NOSTATECHANGE) :
+		Source(source),
+		Trigger(trigger),
+		Target(target)
+	{
+	}
+
+	constexpr FlatTransitionDescriptor(EnumState source, EnumTrigger trigger,
+		TriggerGuard guard, EnumState target = EnumState::NOSTATECHANGE) :
+		Source(source),
+		Trigger(trigger),
+		Guard(guard),
+		Target(target),
+		HasGuard(true)
+	{
+	}
+};
+
+template <class T, typename EnumTrigger, typename EnumState>
+struct FlatHandler
+{
+	typename FlatTransitionDescriptor<T, EnumTrigger, EnumState>::TriggerGuard Guard = nullptr;
+	short Source = RESERVED_NO_STATE;
+	short Target = RESERVED_NO_STATE_CHANGE;
+	short Next = RESERVED_NO_STATE;
+};
+
+template <class T, typename EnumTrigger, int numTriggers, typename EnumState, int numStates, int numTransitions>
+struct FlatTable
+{
+	typedef typename FlatStateDescriptor<T, EnumState>::Action Action;
+
+	short Parent[numStates] = {};
+	short DefaultEntry[numStates] = {};
+	short Depth[numStates] = {};
+	short Triggerless[numStates] = {};
+
+	// Described states without a default entry, the only states the
+	// machine can rest in.
+	bool Leaf[numStates] = {};
+	Action Entry[numStates] = {};
+	Action Exit[numStates] = {};
+
+	FlatHandler<T, EnumTrigger, EnumState> Handlers[numTransitions] = {};
+
+	// Deepest proper common ancestor of each (source, target) pair,
+	// where a transition stops exiting and starts entering.
+	short Lca[numStates][numStates] = {};
+
+	// The states from the root down to each state followed by its
+	// default entry chain, indexed by depth, so entering a target
+	// from an ancestor walks the tail of one row.
+	short EntryPath[numStates][numStates] = {};
+	short EntryLength[numStates] = {};
+
+	// Index into Handlers of the innermost transition for each
+	// (leaf state, trigger) pair or RESERVED_NO_STATE if no state
+	// in the active configuration handles the trigger.
+	short Dispatch[numStates][numTriggers] = {};
+};
+
+template <class T, typename EnumTrigger, int numTriggers, typename EnumState, int numStates, int numStatesDescribed, int numTransitions>
+constexpr FlatTable<T, EnumTrigger, numTriggers, EnumState, numStates, numTransitions> BuildFlatTable(
+	const FlatStateDescriptor<T, EnumState>(&states)[numStatesDescribed],
+	const FlatTransitionDescriptor<T, EnumTrigger, EnumState>(&transitions)[numTransitions])
+{
+	FlatTable<T, EnumTrigger, numTriggers, EnumState, numStates, numTransitions> table;
+
+	for (int i = 0; i < numStates; i++)
+	{
+		table.Parent[i] = RESERVED_NO_STATE;
+		table.DefaultEntry[i] = RESERVED_NO_STATE;
+		table.Triggerless[i] = RESERVED_NO_STATE_CHANGE;
+		for (int j = 0; j < numTriggers; j++)
+		{
+			table.Dispatch[i][j] = RESERVED_NO_STATE;
+		}
+	}
+
+	for (int i = 0; i < numStatesDescribed; i++)
+	{
+		int id = (int)states[i].Id;
+
+		table.Parent[id] = (short)states[i].Parent;
+		table.DefaultEntry[id] = (short)states[i].DefaultEntry;
+		table.Entry[id] = states[i].Entry;
+		table.Exit[id] = states[i].Exit;
+		table.Triggerless[id] = (short)states[i].Triggerless;
+		table.Leaf[id] = states[i].DefaultEntry == EnumState::NOSTATE;
+	}
+
+	for (int i = 0; i < numStates; i++)
+	{
+		short depth = 0;
+		for (int s = table.Parent[i]; s != RESERVED_NO_STATE; s = table.Parent[s])
+		{
+			depth++;
+		}
+		table.Depth[i] = depth;
+	}
+
+	for (int target = 0; target < numStates; target++)
+	{
+		short length = table.Depth[target] + 1;
+		for (int s = target, depth = length - 1; s != RESERVED_NO_STATE; s = table.Parent[s], depth--)
+		{
+			table.EntryPath[target][depth] = (short)s;
+		}
+		for (int s = table.DefaultEntry[target]; s != RESERVED_NO_STATE; s = table.DefaultEntry[s])
+		{
+			table.EntryPath[target][length++] = (short)s;
+		}
+		table.EntryLength[target] = length;
+	}
+
+	for (int source = 0; source < numStates; source++)
+	{
+		for (int target = 0; target < numStates; target++)
+		{
+			int a = table.Parent[source];
+			int b = table.Parent[target];
+			int depthA = table.Depth[source] - 1;
+			int depthB = table.Depth[target] - 1;
+
+			while (depthA > depthB)
+			{
+				a = table.Parent[a];
+				depthA--;
+			}
+			while (depthB > depthA)
+			{
+				b = table.Parent[b];
+				depthB--;
+			}
+			while (a != b)
+			{
+				a = table.Parent[a];
+				b = table.Parent[b];
+			}
+			table.Lca[source][target] = (short)a;
+		}
+	}
+
+	// A state's own transition for a trigger takes precedence over
+	// the transitions of its ancestors, so each handler links to the
+	// handler of the nearest enclosing state for the same trigger.
+	for (int i = 0; i < numTransitions; i++)
+	{
+		table.Handlers[i].Guard = transitions[i].Guard;
+		table.Handlers[i].Source = (short)transitions[i].Source;
+		table.Handlers[i].Target = (short)transitions[i].Target;
+	}
+
+	for (int leaf = 0; leaf < numStates; leaf++)
+	{
+		for (int trigger = 0; trigger < numTriggers; trigger++)
+		{
+			short* link = &table.Dispatch[leaf][trigger];
+
+			for (int s = leaf; s != RESERVED_NO_STATE; s = table.Parent[s])
+			{
+				for (int i = 0; i < numTransitions; i++)
+				{
+					if ((int)transitions[i].Source == s &&
+						(int)transitions[i].Trigger == trigger)
+					{
+						*link = (short)i;
+						link = &table.Handlers[i].Next;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	return table;
+}
+
+enum class FlatDefinitionError
+{
+	None,
+	StateOutOfRange,
+	DuplicateState,
+	UndescribedState,
+	ParentCycle,
+	MissingDefaultEntry,
+	DefaultEntryNotChild,
+	TriggerOutOfRange,
+	MissingGuard,
+	DuplicateTransition,
+	TriggerlessOnComposite,
+	TriggerlessLoop,
+	UnreachableState
+};
+
+template <int numTriggers, int numStates, class T, typename EnumTrigger, typename EnumState, int numStatesDescribed, int numTransitions>
+constexpr FlatDefinitionError ValidateFlatDefinition(
+	const FlatStateDescriptor<T, EnumState>(&states)[numStatesDescribed],
+	const FlatTransitionDescriptor<T, EnumTrigger, EnumState>(&transitions)[numTransitions],
+	EnumState defaultEntryState)
+{
+	bool described[numStates] = {};
+	bool composite[numStates] = {};
+	int parent[numStates] = {};
+	int defaultEntry[numStates] = {};
+	int triggerless[numStates] = {};
+
+	for (int i = 0; i < numStatesDescribed; i++)
+	{
+		int id = (int)states[i].Id;
+
+		if (id < 0 || id >= numStates)
+		{
+			return FlatDefinitionError::StateOutOfRange;
+		}
+		if (described[id])
+		{
+			return FlatDefinitionError::DuplicateState;
+		}
+
+		described[id] = true;
+		parent[id] = (int)states[i].Parent;
+		defaultEntry[id] = (int)states[i].DefaultEntry;
+		triggerless[id] = (int)states[i].Triggerless;
+	}
+
+	// A reference is either one of the allowed reserved values or a
+	// described state.
+	auto check = [&](int state, int reserved1, int reserved2)
+	{
+		if (state == reserved1 || state == reserved2)
+		{
+			return FlatDefinitionError::None;
+		}
+		if (state < 0 || state >= numStates)
+		{
+			return FlatDefinitionError::StateOutOfRange;
+		}
+		return described[state] ? FlatDefinitionError::None : FlatDefinitionError::UndescribedState;
+	};
+
+	FlatDefinitionError error = check((int)defaultEntryState, numStates, numStates);
+	if (error != FlatDefinitionError::None)
+	{
+		return error;
+	}
+
+	for (int s = 0; s < numStates; s++)
+	{
+		if (!described[s])
+		{
+			continue;
+		}
+
+		if ((error = check(parent[s], RESERVED_NO_STATE, RESERVED_NO_STATE)) != FlatDefinitionError::None ||
+			(error = check(defaultEntry[s], RESERVED_NO_STATE, RESERVED_NO_STATE)) != FlatDefinitionError::None ||
+			(error = check(triggerless[s], RESERVED_NO_STATE, RESERVED_NO_STATE_CHANGE)) != FlatDefinitionError::None)
+		{
+			return error;
+		}
+
+		if (parent[s] != RESERVED_NO_STATE)
+		{
+			composite[parent[s]] = true;
+		}
+
+		int depth = 0;
+		for (int a = parent[s]; a != RESERVED_NO_STATE; a = parent[a])
+		{
+			if (++depth > numStates)
+			{
+				return FlatDefinitionError::ParentCycle;
+			}
+		}
+	}
+
+	for (int s = 0; s < numStates; s++)
+	{
+		if (composite[s] && defaultEntry[s] == RESERVED_NO_STATE)
+		{
+			return FlatDefinitionError::MissingDefaultEntry;
+		}
+		if (described[s] && defaultEntry[s] != RESERVED_NO_STATE && parent[defaultEntry[s]] != s)
+		{
+			return FlatDefinitionError::DefaultEntryNotChild;
+		}
+		if (composite[s] && triggerless[s] != RESERVED_NO_STATE_CHANGE)
+		{
+			return FlatDefinitionError::TriggerlessOnComposite;
+		}
+	}
+
+	bool targetsKnown = true;
+
+	for (int i = 0; i < numTransitions; i++)
+	{
+		int trigger = (int)transitions[i].Trigger;
+		int target = (int)transitions[i].Target;
+
+		if ((error = check((int)transitions[i].Source, numStates, numStates)) != FlatDefinitionError::None ||
+			(error = check(target, RESERVED_NO_STATE, RESERVED_NO_STATE_CHANGE)) != FlatDefinitionError::None)
+		{
+			return error;
+		}
+		if (trigger < 0 || trigger >= numTriggers)
+		{
+			return FlatDefinitionError::TriggerOutOfRange;
+		}
+		if (!transitions[i].HasGuard && target == RESERVED_NO_STATE_CHANGE)
+		{
+			return FlatDefinitionError::MissingGuard;
+		}
+		if (target == RESERVED_NO_STATE_CHANGE)
+		{
+			targetsKnown = false;
+		}
+
+		for (int j = 0; j < i; j++)
+		{
+			if (transitions[j].Source == transitions[i].Source &&
+				transitions[j].Trigger == transitions[i].Trigger)
+			{
+				return FlatDefinitionError::DuplicateTransition;
+			}
+		}
+	}
+
+	auto enterLeaf = [&](int state)
+	{
+		while (defaultEntry[state] != RESERVED_NO_STATE)
+		{
+			state = defaultEntry[state];
+		}
+		return state;
+	};
+
+	for (int s = 0; s < numStates; s++)
+	{
+		int hops = 0;
+		for (int leaf = s; described[leaf] && triggerless[leaf] >= 0; leaf = enterLeaf(triggerless[leaf]))
+		{
+			if (++hops > numStates)
+			{
+				return FlatDefinitionError::TriggerlessLoop;
+			}
+		}
+	}
+
+	if (!targetsKnown)
+	{
+		return FlatDefinitionError::None;
+	}
+
+	// Entering a state makes it, its ancestors and its default entry
+	// chain active, and a triggerless hop or a transition out of an
+	// active state enters its target.  Each state is entered once.
+	bool active[numStates] = {};
+	int entered[numStates] = {};
+	int count = 0;
+
+	entered[count++] = (int)defaultEntryState;
+	for (int next = 0; next < count; next++)
+	{
+		int leaf = enterLeaf(entered[next]);
+
+		for (int s = entered[next]; s != RESERVED_NO_STATE; s = parent[s])
+		{
+			active[s] = true;
+		}
+		for (int s = leaf; s != entered[next]; s = parent[s])
+		{
+			active[s] = true;
+		}
+		for (int i = -1; i < numTransitions; i++)
+		{
+			int target = i < 0 ? triggerless[leaf] :
+				active[(int)transitions[i].Source] ? (int)transitions[i].Target : RESERVED_NO_STATE;
+
+			bool queued = target < 0;
+			for (int j = 0; j < count && !queued; j++)
+			{
+				queued = entered[j] == target;
+			}
+			if (!queued)
+			{
+				entered[count++] = target;
+			}
+		}
+	}
+
+	for (int s = 0; s < numStates; s++)
+	{
+		if (described[s] && !active[s])
+		{
+			return FlatDefinitionError::UnreachableState;
+		}
+	}
+
+	return FlatDefinitionError::None;
+}
+
+template <class Machine>
+class FlatPopulation;
+
+template <class T, typename EnumTrigger, int numTriggers, typename EnumState, int numStates, EnumState defaultEntryState>
+class FlatStateMachine
+{
+	template <class Machine>
+	friend class FlatPopulation;
+
+private:
+	EnumState _currentState = EnumState::NOSTATE;
+	bool _replayMode = false;
+
+	template <class Definition>
+	static constexpr auto BuildTable()
+	{
+		constexpr FlatDefinitionError error = ValidateFlatDefinition<numTriggers, numStates>(
+			Definition::States, Definition::Transitions, defaultEntryState);
+
+		static_assert(error != FlatDefinitionError::StateOutOfRange, "Flat definition names a state outside the state enumeration");
+		static_assert(error != FlatDefinitionError::DuplicateState, "Flat definition describes a state twice");
+		static_assert(error != FlatDefinitionError::UndescribedState, "Flat definition refers to a state it does not describe");
+		static_assert(error != FlatDefinitionError::ParentCycle, "Flat definition has a cycle of parent states");
+		static_assert(error != FlatDefinitionError::MissingDefaultEntry, "Flat definition has a composite state without a default entry");
+		static_assert(error != FlatDefinitionError::DefaultEntryNotChild, "Flat definition has a default entry that is not a child of its state");
+		static_assert(error != FlatDefinitionError::TriggerOutOfRange, "Flat definition names a trigger outside the trigger enumeration");
+		static_assert(error != FlatDefinitionError::MissingGuard, "Flat definition has a transition with neither guard nor target");
+		static_assert(error != FlatDefinitionError::DuplicateTransition, "Flat definition has two transitions for the same state and trigger");
+		static_assert(error != FlatDefinitionError::TriggerlessOnComposite, "Flat definition has a triggerless transition on a composite state");
+		static_assert(error != FlatDefinitionError::TriggerlessLoop, "Flat definition has a loop of triggerless transitions");
+		static_assert(error != FlatDefinitionError::UnreachableState, "Flat definition has a state that can never be entered");
+
+		return BuildFlatTable<T, EnumTrigger, numTriggers, EnumState, numStates>(Definition::States, Definition::Transitions);
+	}
+
+	// The table is only instantiated from member function bodies so
+	// that T::Definition may refer to the members of the complete T.
+	template <class Definition>
+	static constexpr auto Table = BuildTable<Definition>();
+
+	static const auto& GetTable()
+	{
+		return Table<typename T::Definition>;
+	}
+
+	void Enter(int state)
+	{
+		auto entry = GetTable().Entry[state];
+		if (entry != nullptr)
+		{
+			(((T*)this)->*entry)();
+		}
+	}
+
+	void Exit(int state)
+	{
+		auto exit = GetTable().Exit[state];
+		if (exit != nullptr)
+		{
+			(((T*)this)->*exit)();
+		}
+	}
+
+	void ExitTo(int ancestor)
+	{
+		const auto& table = GetTable();
+
+		for (int s = (int)_currentState; s != ancestor; s = table.Parent[s])
+		{
+			Exit(s);
+		}
+		_currentState = EnumState::NOSTATE;
+	}
+
+	void EnterFrom(int ancestor, int target)
+	{
+		const auto& table = GetTable();
+
+		const short* path = table.EntryPath[target];
+		int length = table.EntryLength[target];
+
+		for (int depth = ancestor == RESERVED_NO_STATE ? 0 : table.Depth[ancestor] + 1; depth < length; depth++)
+		{
+			Enter(path[depth]);
+		}
+
+		int leaf = path[length - 1];
+		_currentState = (EnumState)leaf;
+
+		// The validation rules out loops, so this recursion ends.
+		if (GetTable().Triggerless[leaf] != RESERVED_NO_STATE_CHANGE)
+		{
+			Transition<T, EnumState> transition;
+			transition.TargetState = (EnumState)GetTable().Triggerless[leaf];
+			ChangeState(leaf, transition);
+		}
+	}
+
+	void ChangeState(int source, Transition<T, EnumState>& transition)
+	{
+		int target = (int)transition.TargetState;
+
+		if (target == RESERVED_NO_STATE)
+		{
+			ExitTo(RESERVED_NO_STATE);
+			transition.Action((T*)this);
+			return;
+		}
+
+		int lca = GetTable().Lca[source][target];
+
+		ExitTo(lca);
+		transition.Action((T*)this);
+		EnterFrom(lca, target);
+	}
+
+public:
+	typedef EnumTrigger TriggerType;
+	typedef EnumState StateType;
+
+	static constexpr int TriggerCount = numTriggers;
+	static constexpr int StateCount = numStates;
+	static constexpr EnumState DefaultEntryState = defaultEntryState;
+
+	// True while the machine is replayed from a Journal, see
+	// StateTemplate::IsReplayMode().
+	bool IsReplayMode() const { return _replayMode; }
+	void SetReplayMode(bool replayMode) { _replayMode = replayMode; }
+
+	// Returns the active leaf state.
+	EnumState GetCurrentState() { return _currentState; }
+
+	bool IsInState(EnumState state)
+	{
+		const auto& table = GetTable();
+
+		for (int s = (int)_currentState; s != RESERVED_NO_STATE; s = table.Parent[s])
+		{
+			if (s == (int)state)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// The active leaf state is the whole configuration of the engine.
+	// A derived machine with a model hides these with versions that
+	// call them and then write its model.
+	void Save(SnapshotWriter& writer) const
+	{
+		WriteState(writer, _currentState);
+	}
+
+	void Restore(SnapshotReader& reader)
+	{
+		EnumState state = reader.ReadState<EnumState>(numStates);
+
+		// Only a leaf state can be active.
+		if (state != EnumState::NOSTATE && !GetTable().Leaf[(int)state])
+		{
+			reader.Fail();
+			state = EnumState::NOSTATE;
+		}
+		_currentState = state;
+	}
+
+	EnumState Trigger(EnumTrigger trigger)
+	{
+		const auto& table = GetTable();
+
+		switch (trigger)
+		{
+		case EnumTrigger::DEFAULTENTRY:
+		{
+			if (_currentState != EnumState::NOSTATE)
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+
+			EnterFrom(RESERVED_NO_STATE, (int)defaultEntryState);
+			return _currentState;
+		}
+		case EnumTrigger::DEFAULTEXIT:
+		{
+			if (_currentState == EnumState::NOSTATE)
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+
+			ExitTo(RESERVED_NO_STATE);
+			return EnumState::NOSTATE;
+		}
+		default:
+		{
+			if (_currentState == EnumState::NOSTATE)
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+
+			Transition<T, EnumState> transition;
+
+			for (int index = table.Dispatch[(int)_currentState][(int)trigger];
+				index != RESERVED_NO_STATE;
+				index = table.Handlers[index].Next)
+			{
+				const auto& handler = table.Handlers[index];
+
+				transition.TargetState = (EnumState)handler.Target;
+				transition.ClearActions();
+				if (handler.Guard != nullptr)
+				{
+					transition.TargetState = EnumState::NOSTATECHANGE;
+					(((T*)this)->*handler.Guard)(trigger, transition);
+				}
+
+				if (transition.TargetState != EnumState::NOSTATECHANGE)
+				{
+					ChangeState(handler.Source, transition);
+					return transition.TargetState;
+				}
+			}
+		}
+		break;
+		}
+
+		return EnumState::NOSTATECHANGE;
+	}
+};
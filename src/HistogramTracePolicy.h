@@ -0,0 +1,407 @@
+/*
+ * HistogramTracePolicy.h:
+ *	Latency histograms for a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+#include "TracePolicy.h"
+
+// LatencyHistogram counts durations in log linear buckets in the
+// manner of an HDR histogram: values below 8 have a bucket each and
+// every power of two above that is split into 8 buckets, so any
+// recorded value is known to within 12.5%.
+class LatencyHistogram
+{
+public:
+	static constexpr int subBuckets = 8;
+	static constexpr int bucketCount = 62 * subBuckets;
+
+	static int BucketIndex(uint64_t value)
+	{
+		if (value < subBuckets)
+		{
+			return (int)value;
+		}
+
+		int magnitude = 63;
+#if defined(__GNUC__) || defined(__clang__)
+		magnitude -= __builtin_clzll(value);
+#else
+		while ((value >> magnitude) == 0)
+		{
+			magnitude--;
+		}
+#endif
+		int shift = magnitude - 3;
+		return (shift + 1) * subBuckets + (int)((value >> shift) & (subBuckets - 1));
+	}
+
+	// Smallest value that falls in the bucket.
+	static uint64_t BucketValue(int index)
+	{
+		if (index < subBuckets)
+		{
+			return (uint64_t)index;
+		}
+
+		int shift = index / subBuckets - 1;
+		return (uint64_t)(subBuckets + index % subBuckets) << shift;
+	}
+
+	uint64_t Counts[bucketCount] = {};
+
+	uint64_t GetCount() const
+	{
+		uint64_t count = 0;
+		for (uint64_t bucket : Counts)
+		{
+			count += bucket;
+		}
+		return count;
+	}
+
+	// Lower bound of the bucket holding the given percentile.
+	uint64_t GetValueAtPercentile(double percentile) const
+	{
+		uint64_t count = GetCount();
+		uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+		uint64_t seen = 0;
+
+		rank = rank == 0 ? 1 : rank;
+		for (int i = 0; i < bucketCount; i++)
+		{
+			seen += Counts[i];
+			if (seen >= rank)
+			{
+				return BucketValue(i);
+			}
+		}
+		return 0;
+	}
+
+	uint64_t GetMax() const
+	{
+		for (int i = bucketCount - 1; i >= 0; i--)
+		{
+			if (Counts[i] != 0)
+			{
+				return BucketValue(i);
+			}
+		}
+		return 0;
+	}
+};
+
+enum class LatencyKind : uint8_t
+{
+	Guard,
+	Exit,
+	TransitionAction,
+	Entry
+};
+
+// One merged histogram of a snapshot.  Trigger is only meaningful
+// for guards.
+struct LatencyEntry
+{
+	LatencyKind Kind;
+	short State;
+	short Trigger;
+	LatencyHistogram Histogram;
+};
+
+// Trace policy that records how long each guard evaluation, keyed
+// by (state, trigger), and each exit action, transition action and
+// entry action, keyed by state, takes.  A guard of a composite child
+// is timed together with the dispatch into its own children.
+// Durations are in TraceTimestamp() ticks.
+//
+// Each thread counts into its own tables without locks or atomic
+// read-modify-write operations.  A histogram is allocated the first
+// time its key is seen on a thread.  Snapshot() merges the tables of
+// every thread that has used the policy, including threads that have
+// since exited.  maxStates and maxTriggers must cover the state and
+// trigger enumerations of every machine that uses the policy, which
+// is checked at compile time.
+template <int maxStates, int maxTriggers>
+class HistogramTracePolicy
+{
+private:
+	struct ThreadHistogram
+	{
+		std::atomic<uint64_t> Counts[LatencyHistogram::bucketCount] = {};
+
+		void Record(uint64_t value)
+		{
+			std::atomic<uint64_t>& count = Counts[LatencyHistogram::BucketIndex(value)];
+			count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	};
+
+	struct ThreadTable
+	{
+		std::atomic<ThreadHistogram*> Guards[maxStates * maxTriggers] = {};
+		std::atomic<ThreadHistogram*> Exits[maxStates] = {};
+		std::atomic<ThreadHistogram*> TransitionActions[maxStates] = {};
+		std::atomic<ThreadHistogram*> Entries[maxStates] = {};
+
+		// Start times of the activities in progress.  Hooks nest when
+		// the actions of a composite child run the hooks of its own
+		// children.
+		uint64_t Started[64];
+		int Depth = 0;
+
+		~ThreadTable()
+		{
+			for (auto& guard : Guards)
+			{
+				delete guard.load(std::memory_order_relaxed);
+			}
+
+			for (int i = 0; i < maxStates; i++)
+			{
+				delete Exits[i].load(std::memory_order_relaxed);
+				delete TransitionActions[i].load(std::memory_order_relaxed);
+				delete Entries[i].load(std::memory_order_relaxed);
+			}
+		}
+	};
+
+	// Tables are owned here rather than by the threads so that the
+	// counts of exited threads stay in the snapshot.
+	static inline std::mutex _tablesLock;
+	static inline std::vector<std::unique_ptr<ThreadTable>> _tables;
+
+	static ThreadTable& GetTable()
+	{
+		static thread_local ThreadTable* table = nullptr;
+
+		if (table == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(_tablesLock);
+
+			_tables.emplace_back(new ThreadTable());
+			table = _tables.back().get();
+		}
+		return *table;
+	}
+
+	static void Start()
+	{
+		ThreadTable& table = GetTable();
+
+		if (table.Depth < 64)
+		{
+			table.Started[table.Depth] = TraceTimestamp();
+		}
+		table.Depth++;
+	}
+
+	static void Complete(std::atomic<ThreadHistogram*>& slot)
+	{
+		uint64_t now = TraceTimestamp();
+		ThreadTable& table = GetTable();
+
+		if (table.Depth == 0 || --table.Depth >= 64)
+		{
+			return;
+		}
+
+		ThreadHistogram* histogram = slot.load(std::memory_order_relaxed);
+		if (histogram == nullptr)
+		{
+			histogram = new ThreadHistogram();
+			slot.store(histogram, std::memory_order_release);
+		}
+		histogram->Record(now - table.Started[table.Depth]);
+	}
+
+	static void Merge(std::vector<LatencyEntry>& entries, LatencyKind kind, short state, short trigger,
+		const std::atomic<ThreadHistogram*>& slot)
+	{
+		ThreadHistogram* histogram = slot.load(std::memory_order_acquire);
+		if (histogram == nullptr)
+		{
+			return;
+		}
+
+		LatencyEntry* entry = nullptr;
+		for (LatencyEntry& existing : entries)
+		{
+			if (existing.Kind == kind && existing.State == state && existing.Trigger == trigger)
+			{
+				entry = &existing;
+				break;
+			}
+		}
+
+		if (entry == nullptr)
+		{
+			entries.push_back({ kind, state, trigger });
+			entry = &entries.back();
+		}
+
+		for (int i = 0; i < LatencyHistogram::bucketCount; i++)
+		{
+			entry->Histogram.Counts[i] += histogram->Counts[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	template <typename EnumState>
+	static int StateIndex(EnumState state)
+	{
+		static_assert((int)EnumState::Count <= maxStates,
+			"State enumeration does not fit; raise maxStates");
+		assert((int)state >= 0 && (int)state < maxStates);
+		return (int)state;
+	}
+
+	template <typename EnumState, typename EnumTrigger>
+	static int GuardIndex(EnumState state, EnumTrigger trigger)
+	{
+		static_assert((int)EnumTrigger::Count <= maxTriggers,
+			"Trigger enumeration does not fit; raise maxTriggers");
+		assert((int)trigger >= 0 && (int)trigger < maxTriggers);
+		return StateIndex(state) * maxTriggers + (int)trigger;
+	}
+
+public:
+	template <typename EnumState, typename EnumTrigger>
+	static void TriggerReceived(const void*, EnumState, EnumTrigger)
+	{
+		Start();
+	}
+
+	template <typename EnumState, typename EnumTrigger>
+	static void GuardEvaluated(const void*, EnumState state, EnumTrigger trigger, EnumState)
+	{
+		Complete(GetTable().Guards[GuardIndex(state, trigger)]);
+	}
+
+	template <typename EnumState>
+	static void Exit(const void*, EnumState)
+	{
+		Start();
+	}
+
+	template <typename EnumState>
+	static void ExitCompleted(const void*, EnumState state)
+	{
+		Complete(GetTable().Exits[StateIndex(state)]);
+	}
+
+	template <typename EnumState>
+	static void TransitionAction(const void*, EnumState)
+	{
+		Start();
+	}
+
+	template <typename EnumState>
+	static void TransitionActionCompleted(const void*, EnumState state)
+	{
+		Complete(GetTable().TransitionActions[StateIndex(state)]);
+	}
+
+	template <typename EnumState>
+	static void Entry(const void*, EnumState)
+	{
+		Start();
+	}
+
+	template <typename EnumState>
+	static void EntryCompleted(const void*, EnumState state)
+	{
+		Complete(GetTable().Entries[StateIndex(state)]);
+	}
+
+	template <typename EnumState>
+	static void TriggerlessHop(const void*, EnumState, EnumState) {}
+
+	template <typename EnumState>
+	static void TriggerlessCompleted(const void*, EnumState, int) {}
+
+	template <typename EnumState>
+	static void TriggerlessStopped(const void*, EnumState, EnumState, int) {}
+
+	// Merges the histograms of all threads.  Threads may keep
+	// recording while the snapshot is taken.
+	static std::vector<LatencyEntry> Snapshot()
+	{
+		std::vector<LatencyEntry> entries;
+		std::lock_guard<std::mutex> lock(_tablesLock);
+
+		for (const std::unique_ptr<ThreadTable>& table : _tables)
+		{
+			for (int state = 0; state < maxStates; state++)
+			{
+				for (int trigger = 0; trigger < maxTriggers; trigger++)
+				{
+					Merge(entries, LatencyKind::Guard, (short)state, (short)trigger,
+						table->Guards[state * maxTriggers + trigger]);
+				}
+				Merge(entries, LatencyKind::Exit, (short)state, RESERVED_NO_STATE_CHANGE,
+					table->Exits[state]);
+				Merge(entries, LatencyKind::TransitionAction, (short)state, RESERVED_NO_STATE_CHANGE,
+					table->TransitionActions[state]);
+				Merge(entries, LatencyKind::Entry, (short)state, RESERVED_NO_STATE_CHANGE,
+					table->Entries[state]);
+			}
+		}
+		return entries;
+	}
+
+	// Writes a snapshot as a JSON array with the count and a few
+	// percentiles of each histogram.
+	static void Write(FILE* file, const std::vector<LatencyEntry>& entries)
+	{
+		static const char* kinds[] = { "guard", "exit", "transition_action", "entry" };
+
+		fprintf(file, "[");
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			const LatencyEntry& entry = entries[i];
+			const LatencyHistogram& histogram = entry.Histogram;
+
+			fprintf(file,
+				"%s\n  { \"kind\": \"%s\", \"state\": %d, \"trigger\": %d, \"count\": %llu, "
+				"\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu }",
+				i == 0 ? "" : ",",
+				kinds[(int)entry.Kind],
+				entry.State,
+				entry.Trigger,
+				(unsigned long long)histogram.GetCount(),
+				(unsigned long long)histogram.GetValueAtPercentile(50.0),
+				(unsigned long long)histogram.GetValueAtPercentile(99.0),
+				(unsigned long long)histogram.GetValueAtPercentile(99.9),
+				(unsigned long long)histogram.GetMax());
+		}
+		fprintf(file, "\n]\n");
+	}
+};
@@ -0,0 +1,561 @@
+/*
+ * Journal.h:
+ *	Append only trigger journal with checkpoints and replay.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "StateMachine.h"
+
+// JournalFile maps an append only file into memory.  The file starts
+// with a small header holding the number of record bytes written and
+// the offset of the latest checkpoint, followed by the records.  The
+// record size is only advanced once a record is complete, so a crash
+// while appending loses at most that record.  The mapping doubles
+// when it fills up.
+class JournalFile
+{
+private:
+	struct Header
+	{
+		char Magic[8];
+		uint64_t Size;
+		uint64_t Checkpoint;
+	};
+
+	static constexpr size_t HeaderSize = 64;
+	static constexpr char Magic[8] = { 'S', 'M', 'J', 'R', 'N', 'L', '0', '1' };
+
+	unsigned char* _data = nullptr;
+	size_t _capacity = 0;
+	size_t _maxCapacity = SIZE_MAX;
+#ifdef _WIN32
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = nullptr;
+#else
+	int _file = -1;
+#endif
+
+	Header& GetHeader() const { return *(Header*)_data; }
+
+	void Unmap()
+	{
+		if (_data == nullptr)
+		{
+			return;
+		}
+
+#ifdef _WIN32
+		UnmapViewOfFile(_data);
+		CloseHandle(_mapping);
+		_mapping = nullptr;
+#else
+		munmap(_data, _capacity);
+#endif
+		_data = nullptr;
+		_capacity = 0;
+	}
+
+	// Grows the file to capacity bytes when needed and maps it.  The
+	// old mapping is only released once the new one is in place, so a
+	// failed remap leaves the journal as it was.
+	bool Map(size_t capacity)
+	{
+#ifdef _WIN32
+		HANDLE mapping = CreateFileMappingA(_file, nullptr, PAGE_READWRITE,
+			(DWORD)((uint64_t)capacity >> 32), (DWORD)capacity, nullptr);
+		if (mapping == nullptr)
+		{
+			return false;
+		}
+
+		unsigned char* data = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity);
+		if (data == nullptr)
+		{
+			CloseHandle(mapping);
+			return false;
+		}
+
+		Unmap();
+		_mapping = mapping;
+#else
+		struct stat status;
+		if (fstat(_file, &status) != 0)
+		{
+			return false;
+		}
+		if ((size_t)status.st_size < capacity && ftruncate(_file, (off_t)capacity) != 0)
+		{
+			return false;
+		}
+
+		void* mapped = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+		if (mapped == MAP_FAILED)
+		{
+			return false;
+		}
+		unsigned char* data = (unsigned char*)mapped;
+
+		Unmap();
+#endif
+		_data = data;
+		_capacity = capacity;
+		return true;
+	}
+
+	size_t GetFileSize() const
+	{
+#ifdef _WIN32
+		LARGE_INTEGER size;
+		return GetFileSizeEx(_file, &size) ? (size_t)size.QuadPart : 0;
+#else
+		struct stat status;
+		return fstat(_file, &status) == 0 ? (size_t)status.st_size : 0;
+#endif
+	}
+
+public:
+	JournalFile()
+	{
+	}
+
+	~JournalFile()
+	{
+		Close();
+	}
+
+	JournalFile(const JournalFile&) = delete;
+	JournalFile& operator=(const JournalFile&) = delete;
+
+	// Opens an existing journal or creates an empty one.  Fails when
+	// the file exists but is not a journal.
+	bool Open(const char* path, size_t capacity = 1 << 20)
+	{
+		Close();
+
+#ifdef _WIN32
+		_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (_file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+#else
+		_file = open(path, O_RDWR | O_CREAT, 0644);
+		if (_file < 0)
+		{
+			return false;
+		}
+#endif
+
+		size_t fileSize = GetFileSize();
+		bool created = fileSize == 0;
+
+		if (!created && fileSize < HeaderSize)
+		{
+			Close();
+			return false;
+		}
+
+		if (capacity < HeaderSize)
+		{
+			capacity = HeaderSize;
+		}
+		if (!Map(fileSize > capacity ? fileSize : capacity))
+		{
+			Close();
+			return false;
+		}
+
+		if (created)
+		{
+			memset(_data, 0, HeaderSize);
+			memcpy(GetHeader().Magic, Magic, sizeof(Magic));
+		}
+		else if (memcmp(GetHeader().Magic, Magic, sizeof(Magic)) != 0 ||
+			HeaderSize + GetHeader().Size > _capacity ||
+			GetHeader().Checkpoint > GetHeader().Size)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+		Unmap();
+
+#ifdef _WIN32
+		if (_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(_file);
+			_file = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (_file >= 0)
+		{
+			close(_file);
+			_file = -1;
+		}
+#endif
+	}
+
+	bool IsOpen() const { return _data != nullptr; }
+
+	// Writes the mapped pages back to the file.
+	bool Flush()
+	{
+		if (!IsOpen())
+		{
+			return false;
+		}
+
+#ifdef _WIN32
+		return FlushViewOfFile(_data, HeaderSize + GetSize()) && FlushFileBuffers(_file);
+#else
+		return msync(_data, HeaderSize + GetSize(), MS_SYNC) == 0;
+#endif
+	}
+
+	// A closed file has no records.
+	const unsigned char* GetRecords() const { return IsOpen() ? _data + HeaderSize : nullptr; }
+	uint64_t GetSize() const { return IsOpen() ? GetHeader().Size : 0; }
+
+	// Offset of the latest checkpoint record plus one, zero if there
+	// is none.
+	uint64_t GetCheckpoint() const { return IsOpen() ? GetHeader().Checkpoint : 0; }
+	void SetCheckpoint(uint64_t checkpoint) { GetHeader().Checkpoint = checkpoint; }
+
+	// Largest size in bytes, header included, that the file may grow
+	// to.  Unlimited by default.
+	void SetMaxCapacity(size_t maxCapacity) { _maxCapacity = maxCapacity; }
+	size_t GetMaxCapacity() const { return _maxCapacity; }
+
+	// Returns room for bytes more record bytes, or nullptr when the
+	// journal is closed or the file cannot grow.  Nothing is recorded
+	// until Commit().
+	unsigned char* Reserve(size_t bytes)
+	{
+		if (!IsOpen())
+		{
+			return nullptr;
+		}
+
+		size_t needed = HeaderSize + (size_t)GetSize() + bytes;
+
+		if (needed > _capacity)
+		{
+			if (needed > _maxCapacity)
+			{
+				return nullptr;
+			}
+
+			size_t capacity = _capacity * 2;
+			while (capacity < needed)
+			{
+				capacity *= 2;
+			}
+			if (capacity > _maxCapacity)
+			{
+				capacity = _maxCapacity;
+			}
+			if (!Map(capacity))
+			{
+				return nullptr;
+			}
+		}
+		return _data + HeaderSize + GetSize();
+	}
+
+	void Commit(size_t bytes)
+	{
+		GetHeader().Size += bytes;
+	}
+
+	// Drops every record.
+	void Clear()
+	{
+		if (!IsOpen())
+		{
+			return;
+		}
+
+		GetHeader().Size = 0;
+		GetHeader().Checkpoint = 0;
+	}
+};
+
+// Journal records the triggers given to a machine, and their
+// payloads, in a JournalFile, and rebuilds the machine by replaying
+// them.  A trigger is a varint of its value plus three, usually one
+// byte, followed by the raw payload when the trigger type has one.
+// A checkpoint is a zero followed by the length and the bytes of a
+// machine snapshot:
+//
+// Journal<TRIGGERS> journal;
+// journal.Open("machine.journal");
+// journal.Trigger(machine, TRIGGERS::YOURTRIGGER1);
+// journal.Checkpoint(machine);
+//
+// Replay() restores the latest checkpoint and replays the triggers
+// after it with the machine in replay mode, so that actions can skip
+// side effects outside the machine.  Recovery time is bounded by the
+// triggers since the latest checkpoint.
+template <typename EnumTrigger>
+class Journal
+{
+public:
+	typedef TriggerEvent<EnumTrigger> Event;
+	typedef typename Event::Payload Payload;
+
+private:
+	static constexpr bool HasPayload = !std::is_same<Payload, NoPayload>::value;
+	static constexpr size_t MaxVarintSize = 10;
+	static constexpr uint64_t CheckpointTag = 0;
+	static constexpr int TriggerBias = 3;
+
+	JournalFile _file;
+	std::vector<unsigned char> _snapshot;
+
+	static size_t EncodeVarint(unsigned char* data, uint64_t value)
+	{
+		size_t size = 0;
+		while (value >= 0x80)
+		{
+			data[size++] = (unsigned char)(value | 0x80);
+			value >>= 7;
+		}
+		data[size++] = (unsigned char)value;
+		return size;
+	}
+
+	static bool DecodeVarint(const unsigned char*& data, const unsigned char* end, uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && data != end; shift += 7)
+		{
+			unsigned char byte = *data++;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+public:
+	bool Open(const char* path, size_t capacity = 1 << 20) { return _file.Open(path, capacity); }
+	void Close() { _file.Close(); }
+	bool Flush() { return _file.Flush(); }
+	void Clear() { _file.Clear(); }
+	void SetMaxCapacity(size_t maxCapacity) { _file.SetMaxCapacity(maxCapacity); }
+
+	bool IsOpen() const { return _file.IsOpen(); }
+	uint64_t GetSize() const { return _file.GetSize(); }
+
+	bool Append(const Event& event)
+	{
+		unsigned char* data = _file.Reserve(MaxVarintSize + sizeof(Payload));
+		if (data == nullptr)
+		{
+			return false;
+		}
+
+		size_t size = EncodeVarint(data, (uint64_t)((int)event.Trigger + TriggerBias));
+		if constexpr (HasPayload)
+		{
+			memcpy(data + size, &event.Data, sizeof(Payload));
+			size += sizeof(Payload);
+		}
+
+		_file.Commit(size);
+		return true;
+	}
+
+	bool Append(EnumTrigger trigger)
+	{
+		return Append(Event{ trigger });
+	}
+
+	// Records the trigger and then gives it to the machine.  Returns
+	// false without giving the trigger to the machine when it could
+	// not be recorded, because the journal is closed or full or the
+	// file could not grow, so the journal never falls behind it.
+	template <class Machine>
+	bool Trigger(Machine& machine, const Event& event)
+	{
+		if (!Append(event))
+		{
+			return false;
+		}
+
+		if constexpr (HasPayload)
+		{
+			machine.Trigger(event);
+		}
+		else
+		{
+			machine.Trigger(event.Trigger);
+		}
+		return true;
+	}
+
+	template <class Machine>
+	bool Trigger(Machine& machine, EnumTrigger trigger)
+	{
+		return Trigger(machine, Event{ trigger });
+	}
+
+	// Appends a snapshot of the machine that replay starts from.
+	template <class Machine>
+	bool Checkpoint(const Machine& machine)
+	{
+		_snapshot.clear();
+		SnapshotWriter writer(_snapshot);
+		machine.Save(writer);
+
+		unsigned char* data = _file.Reserve(2 * MaxVarintSize + _snapshot.size());
+		if (data == nullptr)
+		{
+			return false;
+		}
+
+		size_t size = EncodeVarint(data, CheckpointTag);
+		size += EncodeVarint(data + size, _snapshot.size());
+		memcpy(data + size, _snapshot.data(), _snapshot.size());
+		size += _snapshot.size();
+
+		uint64_t checkpoint = _file.GetSize() + 1;
+		_file.Commit(size);
+		_file.SetCheckpoint(checkpoint);
+		return true;
+	}
+
+	// Rebuilds the machine from the latest checkpoint, or from the
+	// start of the journal when there is none, in which case the
+	// machine must not have been entered yet.  Returns the number of
+	// triggers replayed, or -1 when the journal is closed or corrupt.
+	template <class Machine>
+	int64_t Replay(Machine& machine)
+	{
+		if (!IsOpen())
+		{
+			return -1;
+		}
+
+		const unsigned char* data = _file.GetRecords();
+		const unsigned char* end = data + _file.GetSize();
+		uint64_t checkpoint = _file.GetCheckpoint();
+		int64_t count = 0;
+
+		machine.SetReplayMode(true);
+
+		if (checkpoint != 0)
+		{
+			data += checkpoint - 1;
+
+			uint64_t tag;
+			uint64_t length;
+			if (!DecodeVarint(data, end, tag) || tag != CheckpointTag ||
+				!DecodeVarint(data, end, length) || length > (uint64_t)(end - data))
+			{
+				machine.SetReplayMode(false);
+				return -1;
+			}
+
+			SnapshotReader reader(data, (size_t)length);
+			machine.Restore(reader);
+			data += length;
+
+			if (!reader.IsValid())
+			{
+				machine.SetReplayMode(false);
+				return -1;
+			}
+		}
+
+		while (data != end)
+		{
+			uint64_t value;
+			if (!DecodeVarint(data, end, value))
+			{
+				count = -1;
+				break;
+			}
+
+			if (value == CheckpointTag)
+			{
+				uint64_t length;
+				if (!DecodeVarint(data, end, length) || length > (uint64_t)(end - data))
+				{
+					count = -1;
+					break;
+				}
+				data += length;
+				continue;
+			}
+
+			// Only DEFAULTEXIT, DEFAULTENTRY and the triggers below
+			// Count were ever recorded.
+			if (value >= (uint64_t)TriggerBias + (uint64_t)EnumTrigger::Count)
+			{
+				count = -1;
+				break;
+			}
+
+			Event event{ (EnumTrigger)((int)value - TriggerBias) };
+			if constexpr (HasPayload)
+			{
+				if ((size_t)(end - data) < sizeof(Payload))
+				{
+					count = -1;
+					break;
+				}
+				memcpy(&event.Data, data, sizeof(Payload));
+				data += sizeof(Payload);
+				machine.Trigger(event);
+			}
+			else
+			{
+				machine.Trigger(event.Trigger);
+			}
+			count++;
+		}
+
+		machine.SetReplayMode(false);
+		return count;
+	}
+};
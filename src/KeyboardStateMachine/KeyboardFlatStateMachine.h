@@ -0,0 +1,57 @@
+/*
+ * KeyboardFlatStateMachine.h:
+ *	Base classes to support a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include "../FlatStateMachine.h"
+#include "KeyboardStatesTriggers.h"
+
+// Same state chart as KeyboardStateMachine on the flat engine.  All
+// of its transitions have constant targets so any number of
+// keyboards can be stepped together by FlatPopulation.
+class KeyboardFlatStateMachine : public FlatStateMachine<KeyboardFlatStateMachine,
+	KEYBOARDTRIGGERS,
+	(int)KEYBOARDTRIGGERS::Count,
+	KEYBOARDSTATES,
+	(int)KEYBOARDSTATES::Count,
+	KEYBOARDSTATES::DEFAULT>
+{
+public:
+	struct Definition;
+};
+
+struct KeyboardFlatStateMachine::Definition
+{
+	static constexpr FlatStateDescriptor<KeyboardFlatStateMachine, KEYBOARDSTATES> States[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT },
+		{ KEYBOARDSTATES::CAPSLOCKED }
+	};
+
+	static constexpr FlatTransitionDescriptor<KeyboardFlatStateMachine, KEYBOARDTRIGGERS, KEYBOARDSTATES> Transitions[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT, KEYBOARDTRIGGERS::CAPSLOCK, nullptr, KEYBOARDSTATES::CAPSLOCKED },
+		{ KEYBOARDSTATES::DEFAULT, KEYBOARDTRIGGERS::ANYKEY, nullptr, KEYBOARDSTATES::DEFAULT },
+		{ KEYBOARDSTATES::CAPSLOCKED, KEYBOARDTRIGGERS::CAPSLOCK, nullptr, KEYBOARDSTATES::DEFAULT },
+		{ KEYBOARDSTATES::CAPSLOCKED, KEYBOARDTRIGGERS::ANYKEY, nullptr, KEYBOARDSTATES::CAPSLOCKED }
+	};
+};
@@ -39,5 +39,6 @@ enum class KEYBOARDTRIGGERS
 	DEFAULTEXIT = RESERVED_TRIGGER_DEFAULT_EXIT,
 	CAPSLOCK = 0,
 	ANYKEY,
+	TIMEOUT,
 	Count
 };
@@ -22,38 +22,35 @@
 */
 #include "KeyboardStatesTriggersExtended.h"
 #include "CapsLockedExtended.h"
-#include <functional>
 
 
 CapsLockedExtended::CapsLockedExtended(KeyboardStateModel& stateModel) :
 	_stateModel(stateModel)
 {
-	AddTriggerGuard(KEYBOARDTRIGGERSExtended::CAPSLOCK, &CapsLockedExtended::CapsLockTriggerGuard);
+	AddTransition(KEYBOARDTRIGGERSExtended::CAPSLOCK, KEYBOARDSTATESExtended::DEFAULT);
 	AddTriggerGuard(KEYBOARDTRIGGERSExtended::ANYKEY, &CapsLockedExtended::AnyKeyTriggerGuard);
 }
 
-void CapsLockedExtended::CapsLockTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<CapsLockedExtended, KEYBOARDSTATESExtended>& transition)
-{
-	transition.TargetState = KEYBOARDSTATESExtended::DEFAULT;
-}
-
-void CapsLockedExtended::AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<CapsLockedExtended, KEYBOARDSTATESExtended>& transition)
+void CapsLockedExtended::AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, KeyPayload payload,
+	Transition<CapsLockedExtended, KEYBOARDSTATESExtended>& transition)
 {
 	if (_stateModel.GetKeyCount() > 0)
 	{
 		transition.TargetState = KEYBOARDSTATESExtended::CAPSLOCKED;
-
-		
-		std::function<void()> fn = [this]() { _stateModel.DecrementKeyCount(); };
-		transition.Actions = &CapsLockedExtended::AnyKeyTransition;
+		char key = payload.Key;
+		transition.Closure = [this, key]()
+		{
+			// A plain ANYKEY carries no key, the caller has already
+			// stored it in the model.
+			if (key != '\0')
+			{
+				_stateModel.SetPressedKey(key);
+			}
+			_stateModel.DecrementKeyCount();
+		};
 	}
 	else
 	{
 		transition.TargetState = KEYBOARDSTATESExtended::NOSTATE;
 	}
 }
-
-void CapsLockedExtended::AnyKeyTransition()
-{
-	_stateModel.DecrementKeyCount();
-}
@@ -29,15 +29,15 @@
 class CapsLockedExtended : public StateTemplate<CapsLockedExtended,
 	KEYBOARDTRIGGERSExtended,
 	(int)KEYBOARDTRIGGERSExtended::Count,
-	KEYBOARDSTATESExtended>
+	KEYBOARDSTATESExtended,
+	2,    // guards
+	1>    // transitions
 {
 private:
 	KeyboardStateModel& _stateModel;
 
-	void CapsLockTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<CapsLockedExtended, KEYBOARDSTATESExtended>& transition);
-	void AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<CapsLockedExtended, KEYBOARDSTATESExtended>& transition);
-
-	void AnyKeyTransition();
+	void AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, KeyPayload payload,
+		Transition<CapsLockedExtended, KEYBOARDSTATESExtended>& transition);
 
 public:
 	CapsLockedExtended(KeyboardStateModel& stateModel);
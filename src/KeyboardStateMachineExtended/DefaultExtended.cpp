@@ -23,38 +23,35 @@
 #include "KeyboardStatesTriggersExtended.h"
 #include "KeyboardStateModel.h"
 #include "DefaultExtended.h"
-#include <functional>
 
 
 DefaultExtended::DefaultExtended(KeyboardStateModel& stateModel) :
 	_stateModel(stateModel)
 {
-	AddTriggerGuard(KEYBOARDTRIGGERSExtended::CAPSLOCK, &DefaultExtended::CapsLockTriggerGuard);
+	AddTransition(KEYBOARDTRIGGERSExtended::CAPSLOCK, KEYBOARDSTATESExtended::CAPSLOCKED);
 	AddTriggerGuard(KEYBOARDTRIGGERSExtended::ANYKEY, &DefaultExtended::AnyKeyTriggerGuard);
 }
 
-void DefaultExtended::CapsLockTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<DefaultExtended, KEYBOARDSTATESExtended>& transition)
-{
-	transition.TargetState = KEYBOARDSTATESExtended::CAPSLOCKED;
-}
-
-void DefaultExtended::AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<DefaultExtended, KEYBOARDSTATESExtended>& transition)
+void DefaultExtended::AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, KeyPayload payload,
+	Transition<DefaultExtended, KEYBOARDSTATESExtended>& transition)
 {
 	if (_stateModel.GetKeyCount() > 0)
 	{
 		transition.TargetState = KEYBOARDSTATESExtended::DEFAULT;
-
-		std::function<void()> fn = [this]() { _stateModel.DecrementKeyCount(); };
-		transition.Actions = &DefaultExtended::AnyKeyTransition;
+		char key = payload.Key;
+		transition.Closure = [this, key]()
+		{
+			// A plain ANYKEY carries no key, the caller has already
+			// stored it in the model.
+			if (key != '\0')
+			{
+				_stateModel.SetPressedKey(key);
+			}
+			_stateModel.DecrementKeyCount();
+		};
 	}
 	else
 	{
 		transition.TargetState = KEYBOARDSTATESExtended::NOSTATE;
 	}
 }
-
-void DefaultExtended::AnyKeyTransition()
-{
-	_stateModel.DecrementKeyCount();
-}
-
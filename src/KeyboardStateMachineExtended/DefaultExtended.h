@@ -28,15 +28,15 @@
 class DefaultExtended : public StateTemplate<DefaultExtended,
 	KEYBOARDTRIGGERSExtended,
 	(int)KEYBOARDTRIGGERSExtended::Count,
-	KEYBOARDSTATESExtended>
+	KEYBOARDSTATESExtended,
+	2,    // guards
+	1>    // transitions
 {
 private:
 	KeyboardStateModel& _stateModel;
 
-	void CapsLockTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<DefaultExtended, KEYBOARDSTATESExtended>& transition);
-	void AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, Transition<DefaultExtended, KEYBOARDSTATESExtended>& transition);
-
-	void AnyKeyTransition();
+	void AnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger, KeyPayload payload,
+		Transition<DefaultExtended, KEYBOARDSTATESExtended>& transition);
 
 public:
 	DefaultExtended(KeyboardStateModel& stateModel);
@@ -32,6 +32,13 @@ class KeyboardStateMachineExtended : public OrState<KeyboardStateMachineExtended
 	(int)KEYBOARDSTATESExtended::Count,
 	KEYBOARDSTATESExtended::DEFAULT>
 {	
+private:
+	KeyboardStateModel& _stateModel;
+
 public:
 	KeyboardStateMachineExtended(KeyboardStateModel& stateModel);
+
+	// The model is saved and restored with the configuration.
+	void Save(SnapshotWriter& writer) const override;
+	void Restore(SnapshotReader& reader) override;
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*
+ * KeyboardFlatStateMachineExtended.cpp:
+ *	Base classes to support a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+
+#include "KeyboardFlatStateMachineExtended.h"
+
+KeyboardFlatStateMachineExtended::KeyboardFlatStateMachineExtended(KeyboardStateModel& stateModel) :
+	_stateModel(&stateModel)
+{
+}
+
+void KeyboardFlatStateMachineExtended::DefaultAnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger,
+	Transition<KeyboardFlatStateMachineExtended, KEYBOARDSTATESExtended>& transition)
+{
+	if (_stateModel->GetKeyCount() > 0)
+	{
+		transition.TargetState = KEYBOARDSTATESExtended::DEFAULT;
+		transition.Actions = &KeyboardFlatStateMachineExtended::AnyKeyTransition;
+	}
+	else
+	{
+		transition.TargetState = KEYBOARDSTATESExtended::NOSTATE;
+	}
+}
+
+void KeyboardFlatStateMachineExtended::CapsLockedAnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger,
+	Transition<KeyboardFlatStateMachineExtended, KEYBOARDSTATESExtended>& transition)
+{
+	if (_stateModel->GetKeyCount() > 0)
+	{
+		transition.TargetState = KEYBOARDSTATESExtended::CAPSLOCKED;
+		transition.Actions = &KeyboardFlatStateMachineExtended::AnyKeyTransition;
+	}
+	else
+	{
+		transition.TargetState = KEYBOARDSTATESExtended::NOSTATE;
+	}
+}
+
+void KeyboardFlatStateMachineExtended::AnyKeyTransition()
+{
+	_stateModel->DecrementKeyCount();
+}
+
+void KeyboardFlatStateMachineExtended::Save(SnapshotWriter& writer) const
+{
+	FlatStateMachine::Save(writer);
+	writer.WriteVarint((uint32_t)_stateModel->GetKeyCount());
+	writer.Write(_stateModel->GetPressedKey());
+}
+
+void KeyboardFlatStateMachineExtended::Restore(SnapshotReader& reader)
+{
+	FlatStateMachine::Restore(reader);
+	_stateModel->SetKeyCount((int)(uint32_t)reader.ReadVarint());
+	_stateModel->SetPressedKey(reader.Read<char>());
+}
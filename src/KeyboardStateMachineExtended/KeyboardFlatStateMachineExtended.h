@@ -0,0 +1,83 @@
+/*
+ * KeyboardFlatStateMachineExtended.h:
+ *	Base classes to support a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include "../FlatStateMachine.h"
+#include "KeyboardStatesTriggersExtended.h"
+#include "KeyboardStateModel.h"
+
+// Same state chart as KeyboardStateMachineExtended on the shared
+// flat tables.  An instance holds only its active state and a
+// pointer to its KeyboardStateModel.
+class KeyboardFlatStateMachineExtended : public FlatStateMachine<KeyboardFlatStateMachineExtended,
+	KEYBOARDTRIGGERSExtended,
+	(int)KEYBOARDTRIGGERSExtended::Count,
+	KEYBOARDSTATESExtended,
+	(int)KEYBOARDSTATESExtended::Count,
+	KEYBOARDSTATESExtended::DEFAULT>
+{
+private:
+	KeyboardStateModel* _stateModel;
+
+	void DefaultAnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger,
+		Transition<KeyboardFlatStateMachineExtended, KEYBOARDSTATESExtended>& transition);
+	void CapsLockedAnyKeyTriggerGuard(KEYBOARDTRIGGERSExtended trigger,
+		Transition<KeyboardFlatStateMachineExtended, KEYBOARDSTATESExtended>& transition);
+
+	void AnyKeyTransition();
+
+public:
+	struct Definition;
+
+	KeyboardFlatStateMachineExtended(KeyboardStateModel& stateModel);
+
+	KeyboardStateModel& GetStateModel() { return *_stateModel; }
+
+	// The model is saved and restored with the active state.
+	void Save(SnapshotWriter& writer) const;
+	void Restore(SnapshotReader& reader);
+};
+
+struct KeyboardFlatStateMachineExtended::Definition
+{
+	static constexpr FlatStateDescriptor<KeyboardFlatStateMachineExtended,
+		KEYBOARDSTATESExtended> States[] =
+	{
+		{ KEYBOARDSTATESExtended::DEFAULT },
+		{ KEYBOARDSTATESExtended::CAPSLOCKED }
+	};
+
+	static constexpr FlatTransitionDescriptor<KeyboardFlatStateMachineExtended,
+		KEYBOARDTRIGGERSExtended,
+		KEYBOARDSTATESExtended> Transitions[] =
+	{
+		{ KEYBOARDSTATESExtended::DEFAULT, KEYBOARDTRIGGERSExtended::CAPSLOCK,
+			nullptr, KEYBOARDSTATESExtended::CAPSLOCKED },
+		{ KEYBOARDSTATESExtended::DEFAULT, KEYBOARDTRIGGERSExtended::ANYKEY,
+			&KeyboardFlatStateMachineExtended::DefaultAnyKeyTriggerGuard },
+		{ KEYBOARDSTATESExtended::CAPSLOCKED, KEYBOARDTRIGGERSExtended::CAPSLOCK,
+			nullptr, KEYBOARDSTATESExtended::DEFAULT },
+		{ KEYBOARDSTATESExtended::CAPSLOCKED, KEYBOARDTRIGGERSExtended::ANYKEY,
+			&KeyboardFlatStateMachineExtended::CapsLockedAnyKeyTriggerGuard }
+	};
+};
@@ -25,11 +25,26 @@
 #include "DefaultExtended.h"
 #include "CapsLockedExtended.h"
 
-KeyboardStateMachineExtended::KeyboardStateMachineExtended(KeyboardStateModel& stateModel)
+KeyboardStateMachineExtended::KeyboardStateMachineExtended(KeyboardStateModel& stateModel) :
+	_stateModel(stateModel)
 {
 	DefaultExtended* defaultState = new DefaultExtended(stateModel);
 	CapsLockedExtended* capsLockedState = new CapsLockedExtended(stateModel);
 
 	AddState(KEYBOARDSTATESExtended::DEFAULT, defaultState);
 	AddState(KEYBOARDSTATESExtended::CAPSLOCKED, capsLockedState);
+}
+
+void KeyboardStateMachineExtended::Save(SnapshotWriter& writer) const
+{
+	OrState::Save(writer);
+	writer.WriteVarint((uint32_t)_stateModel.GetKeyCount());
+	writer.Write(_stateModel.GetPressedKey());
+}
+
+void KeyboardStateMachineExtended::Restore(SnapshotReader& reader)
+{
+	OrState::Restore(reader);
+	_stateModel.SetKeyCount((int)(uint32_t)reader.ReadVarint());
+	_stateModel.SetPressedKey(reader.Read<char>());
 }
\ No newline at end of file
@@ -41,3 +41,15 @@ enum class KEYBOARDTRIGGERSExtended
 	ANYKEY,
 	Count
 };
+
+// Data carried by every keyboard trigger.
+struct KeyPayload
+{
+	char Key;
+};
+
+template <>
+struct TriggerTraits<KEYBOARDTRIGGERSExtended>
+{
+	typedef KeyPayload Payload;
+};
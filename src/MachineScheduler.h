@@ -0,0 +1,468 @@
+/*
+ * MachineScheduler.h:
+ *	Work stealing scheduler for many C++ UML state machines.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "ActiveObject.h"
+
+// MachineScheduler owns a set of independent top-level state
+// machines, each with its own EventQueue mailbox, and runs them on
+// a pool of worker threads.  Posting an event to a machine whose
+// mailbox was idle makes the machine runnable.  A machine is
+// runnable at most once at any time, so only one worker drains its
+// mailbox and only one event per machine is ever in flight, without
+// a lock around the machine.
+//
+// Each worker keeps runnable machines in its own work stealing
+// deque.  Machines made runnable by a worker (for example by a
+// machine posting to another machine) go to that worker's deque;
+// machines made runnable by other threads go to a shared injection
+// ring.  An idle worker first pops its own deque, then the
+// injection ring and finally steals from the other workers.
+template <class Machine, typename Event, int mailboxCapacity>
+class MachineScheduler
+{
+private:
+	struct Entry
+	{
+		Machine* Instance;
+		EventQueue<Event, mailboxCapacity> Mailbox;
+		std::atomic<bool> Scheduled;
+
+		Entry(Machine& machine) :
+			Instance(&machine),
+			Scheduled(false)
+		{
+		}
+	};
+
+	// Chase-Lev deque.  Every machine is in at most one deque at a
+	// time, so a ring sized for all machines never has to grow.
+	class WorkDeque
+	{
+	private:
+		alignas(64) std::atomic<long> _top;
+		alignas(64) std::atomic<long> _bottom;
+		std::unique_ptr<std::atomic<Entry*>[]> _buffer;
+		long _mask;
+
+	public:
+		WorkDeque(long capacity) :
+			_top(0),
+			_bottom(0),
+			_buffer(new std::atomic<Entry*>[capacity]),
+			_mask(capacity - 1)
+		{
+		}
+
+		// Owner only.
+		void Push(Entry* entry)
+		{
+			long bottom = _bottom.load(std::memory_order_relaxed);
+
+			_buffer[bottom & _mask].store(entry, std::memory_order_relaxed);
+			_bottom.store(bottom + 1, std::memory_order_release);
+		}
+
+		// Owner only.
+		Entry* Pop()
+		{
+			long bottom = _bottom.load(std::memory_order_relaxed) - 1;
+			_bottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			long top = _top.load(std::memory_order_relaxed);
+
+			if (top > bottom)
+			{
+				_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			Entry* entry = _buffer[bottom & _mask].load(std::memory_order_relaxed);
+			if (top == bottom)
+			{
+				if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				{
+					entry = nullptr;
+				}
+				_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return entry;
+		}
+
+		Entry* Steal()
+		{
+			long top = _top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			long bottom = _bottom.load(std::memory_order_acquire);
+
+			if (top >= bottom)
+			{
+				return nullptr;
+			}
+
+			Entry* entry = _buffer[top & _mask].load(std::memory_order_relaxed);
+			if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				return nullptr;
+			}
+			return entry;
+		}
+	};
+
+	// Bounded multi-producer/multi-consumer ring for machines made
+	// runnable from threads that are not workers.
+	class InjectionRing
+	{
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> Sequence;
+			Entry* Value;
+		};
+
+		std::unique_ptr<Cell[]> _cells;
+		size_t _mask;
+		alignas(64) std::atomic<size_t> _enqueue;
+		alignas(64) std::atomic<size_t> _dequeue;
+
+	public:
+		InjectionRing(size_t capacity) :
+			_cells(new Cell[capacity]),
+			_mask(capacity - 1),
+			_enqueue(0),
+			_dequeue(0)
+		{
+			for (size_t i = 0; i < capacity; i++)
+			{
+				_cells[i].Sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		// Never full: every machine is queued at most once.
+		void Push(Entry* entry)
+		{
+			size_t position = _enqueue.load(std::memory_order_relaxed);
+
+			for (;;)
+			{
+				Cell& cell = _cells[position & _mask];
+				size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+				long difference = (long)sequence - (long)position;
+
+				if (difference == 0)
+				{
+					if (_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						cell.Value = entry;
+						cell.Sequence.store(position + 1, std::memory_order_release);
+						return;
+					}
+				}
+				else
+				{
+					position = _enqueue.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		Entry* Pop()
+		{
+			size_t position = _dequeue.load(std::memory_order_relaxed);
+
+			for (;;)
+			{
+				Cell& cell = _cells[position & _mask];
+				size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+				long difference = (long)sequence - (long)(position + 1);
+
+				if (difference == 0)
+				{
+					if (_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						Entry* entry = cell.Value;
+						cell.Sequence.store(position + _mask + 1, std::memory_order_release);
+						return entry;
+					}
+				}
+				else if (difference < 0)
+				{
+					return nullptr;
+				}
+				else
+				{
+					position = _dequeue.load(std::memory_order_relaxed);
+				}
+			}
+		}
+	};
+
+	struct alignas(64) Worker
+	{
+		MachineScheduler* Owner;
+		WorkDeque Deque;
+		std::atomic<size_t> Dispatched;
+		unsigned int Random;
+
+		Worker(MachineScheduler* owner, long capacity, unsigned int seed) :
+			Owner(owner),
+			Deque(capacity),
+			Dispatched(0),
+			Random(seed)
+		{
+		}
+	};
+
+	// Events handed to one machine before it yields its worker.
+	static const int batchSize = 32;
+
+	std::vector<std::unique_ptr<Entry>> _entries;
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::vector<std::thread> _threads;
+	InjectionRing _injection;
+	std::atomic<bool> _running;
+	int _maxMachines;
+
+	static Worker*& CurrentWorker()
+	{
+		static thread_local Worker* worker = nullptr;
+		return worker;
+	}
+
+	static long RoundUpPowerOfTwo(long value)
+	{
+		long result = 1;
+		while (result < value)
+		{
+			result <<= 1;
+		}
+		return result;
+	}
+
+	void MakeRunnable(Entry* entry)
+	{
+		Worker* worker = CurrentWorker();
+
+		if (worker != nullptr && worker->Owner == this)
+		{
+			worker->Deque.Push(entry);
+		}
+		else
+		{
+			_injection.Push(entry);
+		}
+	}
+
+	Entry* FindWork(Worker& worker)
+	{
+		Entry* entry = worker.Deque.Pop();
+		if (entry != nullptr)
+		{
+			return entry;
+		}
+
+		entry = _injection.Pop();
+		if (entry != nullptr)
+		{
+			return entry;
+		}
+
+		size_t count = _workers.size();
+		worker.Random = worker.Random * 1103515245 + 12345;
+		size_t start = (worker.Random >> 16) % count;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			Worker& victim = *_workers[(start + i) % count];
+			if (&victim == &worker)
+			{
+				continue;
+			}
+
+			entry = victim.Deque.Steal();
+			if (entry != nullptr)
+			{
+				return entry;
+			}
+		}
+		return nullptr;
+	}
+
+	void Run(Worker& worker, Entry* entry)
+	{
+		Event event;
+		int count = 0;
+
+		while (count < batchSize && entry->Mailbox.TryTake(event))
+		{
+			entry->Instance->Trigger(event);
+			count++;
+		}
+		worker.Dispatched.fetch_add(count, std::memory_order_relaxed);
+
+		// Give up the machine, then look again in case a producer
+		// posted after the last TryTake but saw it still scheduled.
+		entry->Scheduled.store(false, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		// Only the shared count may be read here: once Scheduled is
+		// false another worker may already be draining the mailbox.
+		if (entry->Mailbox.GetCount() != 0 && !entry->Scheduled.exchange(true, std::memory_order_acq_rel))
+		{
+			worker.Deque.Push(entry);
+		}
+	}
+
+	void WorkerLoop(Worker& worker)
+	{
+		CurrentWorker() = &worker;
+		int idle = 0;
+
+		while (_running.load(std::memory_order_acquire))
+		{
+			Entry* entry = FindWork(worker);
+
+			if (entry != nullptr)
+			{
+				Run(worker, entry);
+				idle = 0;
+			}
+			else if (++idle < 64)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}
+
+		CurrentWorker() = nullptr;
+	}
+
+public:
+	MachineScheduler(int workerCount, int maxMachines) :
+		_injection(RoundUpPowerOfTwo(maxMachines)),
+		_running(false),
+		_maxMachines(maxMachines)
+	{
+		for (int i = 0; i < workerCount; i++)
+		{
+			_workers.emplace_back(new Worker(this, RoundUpPowerOfTwo(maxMachines), 2166136261u + i));
+		}
+	}
+
+	~MachineScheduler()
+	{
+		Stop();
+	}
+
+	// Machines must be added before Start().  Returns the id used
+	// to post to the machine or -1 if the scheduler is full.
+	int Add(Machine& machine)
+	{
+		if ((int)_entries.size() >= _maxMachines)
+		{
+			return -1;
+		}
+
+		_entries.emplace_back(new Entry(machine));
+		return (int)_entries.size() - 1;
+	}
+
+	bool Post(int machineId, const Event& event)
+	{
+		Entry* entry = _entries[machineId].get();
+
+		if (!entry->Mailbox.Post(event))
+		{
+			return false;
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!entry->Scheduled.exchange(true, std::memory_order_acq_rel))
+		{
+			MakeRunnable(entry);
+		}
+		return true;
+	}
+
+	void Start()
+	{
+		if (_running.exchange(true))
+		{
+			return;
+		}
+
+		for (auto& worker : _workers)
+		{
+			Worker* pWorker = worker.get();
+			_threads.emplace_back([this, pWorker]() { WorkerLoop(*pWorker); });
+		}
+	}
+
+	// Events still in a mailbox when the workers stop stay there
+	// until the scheduler is started again.
+	void Stop()
+	{
+		if (!_running.exchange(false))
+		{
+			return;
+		}
+
+		for (auto& thread : _threads)
+		{
+			thread.join();
+		}
+		_threads.clear();
+	}
+
+	size_t GetDispatchedCount() const
+	{
+		size_t count = 0;
+		for (const auto& worker : _workers)
+		{
+			count += worker->Dispatched.load(std::memory_order_relaxed);
+		}
+		return count;
+	}
+
+	size_t GetOverflowCount() const
+	{
+		size_t count = 0;
+		for (const auto& entry : _entries)
+		{
+			count += entry->Mailbox.GetOverflowCount();
+		}
+		return count;
+	}
+
+	int GetMachineCount() const { return (int)_entries.size(); }
+
+	int GetWorkerCount() const { return (int)_workers.size(); }
+};
@@ -0,0 +1,147 @@
+/*
+ * RegionWorkerPool.h:
+ *	Thread pool that dispatches AndState regions in parallel.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "StateMachine.h"
+
+// RegionDispatcher backed by a fixed set of worker threads.  Run()
+// publishes a batch of tasks, the calling thread and the workers
+// claim tasks from a shared counter, and the caller returns once
+// every task has completed.  Idle workers spin briefly, then yield
+// and finally sleep, like the ActiveObject consumer, so a pool
+// shared by several AndStates costs little between triggers.
+//
+// A broadcast only pays off when the regions do enough work per
+// trigger to outweigh waking the workers; small regions are faster
+// dispatched in order.  Tasks must not throw.
+class RegionWorkerPool : public RegionDispatcher
+{
+private:
+	std::vector<std::thread> _workers;
+	std::mutex _runLock;
+	std::atomic<bool> _stop{ false };
+	std::atomic<unsigned> _generation{ 0 };
+	std::atomic<int> _completed{ 0 };
+	std::atomic<void (*)(void*, int)> _task{ nullptr };
+	std::atomic<void*> _context{ nullptr };
+
+	// The task count of the current batch in the high half and the
+	// next unclaimed task in the low half.  A worker that is late for
+	// one batch may claim tasks of the next, so the count and the
+	// index are read together, and the task and context of a batch
+	// are published before the batch is.
+	std::atomic<uint64_t> _claim{ 0 };
+
+	void Work()
+	{
+		for (;;)
+		{
+			uint64_t claim = _claim.fetch_add(1, std::memory_order_acq_rel);
+			uint32_t index = (uint32_t)claim;
+			if (index >= (uint32_t)(claim >> 32))
+			{
+				return;
+			}
+
+			_task.load(std::memory_order_relaxed)(_context.load(std::memory_order_relaxed), (int)index);
+			_completed.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	void WorkerLoop()
+	{
+		unsigned seen = _generation.load(std::memory_order_acquire);
+		int idle = 0;
+
+		while (!_stop.load(std::memory_order_acquire))
+		{
+			unsigned generation = _generation.load(std::memory_order_acquire);
+			if (generation != seen)
+			{
+				seen = generation;
+				idle = 0;
+				Work();
+			}
+			else if (++idle < 1024)
+			{
+			}
+			else if (idle < 2048)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}
+	}
+
+public:
+	// With zero workers every task runs on the calling thread.
+	RegionWorkerPool(int workerCount = (int)std::thread::hardware_concurrency() - 1)
+	{
+		for (int i = 0; i < workerCount; i++)
+		{
+			_workers.emplace_back(&RegionWorkerPool::WorkerLoop, this);
+		}
+	}
+
+	~RegionWorkerPool() override
+	{
+		_stop.store(true, std::memory_order_release);
+		for (std::thread& worker : _workers)
+		{
+			worker.join();
+		}
+	}
+
+	RegionWorkerPool(const RegionWorkerPool&) = delete;
+	RegionWorkerPool& operator=(const RegionWorkerPool&) = delete;
+
+	int GetWorkerCount() const { return (int)_workers.size(); }
+
+	void Run(int count, void (*task)(void* context, int index), void* context) override
+	{
+		std::lock_guard<std::mutex> lock(_runLock);
+
+		_task.store(task, std::memory_order_relaxed);
+		_context.store(context, std::memory_order_relaxed);
+		_completed.store(0, std::memory_order_relaxed);
+		_claim.store((uint64_t)count << 32, std::memory_order_release);
+		_generation.fetch_add(1, std::memory_order_release);
+
+		Work();
+
+		while (_completed.load(std::memory_order_acquire) != count)
+		{
+			std::this_thread::yield();
+		}
+	}
+};
@@ -24,25 +24,26 @@
 #include "S11.h"
 #include <stdio.h>
 
-S1::S1()
+S1::S1(StateArena* arena) :
+	OrState(arena)
 {
-	S11* s11 = new S11();
-	
-	AddState(SSTATES::S11, s11);
+	CreateState<S11>(SSTATES::S11);
 
 	AddTriggerGuard(STRIGGERS::T, &S1::TTriggerGuard);
 }
 
 void S1::TTriggerGuard(STRIGGERS trigger, Transition<S1, SSTATES>& transition)
 {
-	printf("g() : ");
+	if (!IsReplayMode())
+		printf("g() : ");
 	transition.TargetState = SSTATES::S2;
 	transition.Actions = &S1::TTransition;
 }
 
 void S1::TTransition()
 {	
-	printf("t() : ");
+	if (!IsReplayMode())
+		printf("t() : ");
 }
 
 void S1::ExitAction()
@@ -52,5 +53,6 @@ void S1::ExitAction()
 	OrState::ExitAction();
 
 	// Now perform Exit action for this state.
-	printf("b() : ");	
+	if (!IsReplayMode())
+		printf("b() : ");
 }
@@ -29,13 +29,15 @@ class S1 : public OrState<S1,
 	(int)STRIGGERS::Count,
 	SSTATES,
 	(int)SSTATES::Count,
-	SSTATES::S11>
+	SSTATES::S11,
+	1,
+	1>
 {
 	void TTriggerGuard(STRIGGERS trigger, Transition<S1, SSTATES>& transition);
 	void TTransition();
 
 public:
-	S1();
+	S1(StateArena* arena = nullptr);
 
 	void ExitAction() override;
 };
\ No newline at end of file
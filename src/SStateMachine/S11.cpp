@@ -29,5 +29,6 @@ S11::S11()
 
 void S11::ExitAction()
 {
-	printf("a() : ");
+	if (!IsReplayMode())
+		printf("a() : ");
 }
\ No newline at end of file
@@ -28,7 +28,8 @@
 class S11 : public StateTemplate<S11,
 	STRIGGERS,
 	(int)STRIGGERS::Count,
-	SSTATES>
+	SSTATES,
+	0>
 {
 
 public:
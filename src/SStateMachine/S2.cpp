@@ -24,15 +24,18 @@
 #include "S21.h"
 #include <stdio.h>
 
-S2::S2()
+S2::S2(StateArena* arena) :
+	OrState(arena)
 {
-	S21* s21 = new S21();
-
-	AddState(SSTATES::S21, s21);
+	CreateState<S21>(SSTATES::S21);
 }
 
 void S2::EntryAction()
 {
-	printf("c() : ");
-	OrState::ExitAction();
+	if (!IsReplayMode())
+		printf("c() : ");
+
+	// Entry action for this state first, then the default entry
+	// of its children.
+	OrState::EntryAction();
 }
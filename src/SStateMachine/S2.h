@@ -29,10 +29,12 @@ class S2 : public OrState<S2,
 	(int)STRIGGERS::Count,
 	SSTATES,
 	(int)SSTATES::Count,
-	SSTATES::S21>
+	SSTATES::S21,
+	1,
+	0>
 {
 public:
-	S2();
+	S2(StateArena* arena = nullptr);
 
 	void EntryAction() override;
 };
\ No newline at end of file
@@ -29,5 +29,6 @@ S21::S21()
 
 void S21::EntryAction()
 {
-	printf("e() : ");
+	if (!IsReplayMode())
+		printf("e() : ");
 }
\ No newline at end of file
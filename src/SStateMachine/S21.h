@@ -28,7 +28,8 @@
 class S21 : public StateTemplate<S21,
 	STRIGGERS,
 	(int)STRIGGERS::Count,
-	SSTATES>
+	SSTATES,
+	0>
 {
 
 public:
@@ -0,0 +1,62 @@
+/*
+ * SFlat.cpp:
+ *	Base classes to support a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#include "SFlat.h"
+#include <stdio.h>
+
+void SFlat::S1TTriggerGuard(STRIGGERS trigger, Transition<SFlat, SSTATES>& transition)
+{
+	if (!IsReplayMode())
+		printf("g() : ");
+	transition.TargetState = SSTATES::S2;
+	transition.Actions = &SFlat::S1TTransition;
+}
+
+void SFlat::S1TTransition()
+{
+	if (!IsReplayMode())
+		printf("t() : ");
+}
+
+void SFlat::S11ExitAction()
+{
+	if (!IsReplayMode())
+		printf("a() : ");
+}
+
+void SFlat::S1ExitAction()
+{
+	if (!IsReplayMode())
+		printf("b() : ");
+}
+
+void SFlat::S2EntryAction()
+{
+	if (!IsReplayMode())
+		printf("c() : ");
+}
+
+void SFlat::S21EntryAction()
+{
+	if (!IsReplayMode())
+		printf("e() : ");
+}
@@ -0,0 +1,64 @@
+/*
+ * SFlat.h:
+ *	Base classes to support a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include "../FlatStateMachine.h"
+#include "SStatesTriggers.h"
+
+// Same state chart as S but dispatched through the flattened
+// transition table of FlatStateMachine.
+class SFlat : public FlatStateMachine<SFlat,
+	STRIGGERS,
+	(int)STRIGGERS::Count,
+	SSTATES,
+	(int)SSTATES::Count,
+	SSTATES::S>
+{
+	void S1TTriggerGuard(STRIGGERS trigger, Transition<SFlat, SSTATES>& transition);
+	void S1TTransition();
+
+	void S11ExitAction();
+	void S1ExitAction();
+	void S2EntryAction();
+	void S21EntryAction();
+
+public:
+	struct Definition;
+};
+
+struct SFlat::Definition
+{
+	static constexpr FlatStateDescriptor<SFlat, SSTATES> States[] =
+	{
+		{ SSTATES::S, SSTATES::NOSTATE, SSTATES::S1 },
+		{ SSTATES::S1, SSTATES::S, SSTATES::S11, nullptr, &SFlat::S1ExitAction },
+		{ SSTATES::S11, SSTATES::S1, SSTATES::NOSTATE, nullptr, &SFlat::S11ExitAction },
+		{ SSTATES::S2, SSTATES::S, SSTATES::S21, &SFlat::S2EntryAction },
+		{ SSTATES::S21, SSTATES::S2, SSTATES::NOSTATE, &SFlat::S21EntryAction }
+	};
+
+	static constexpr FlatTransitionDescriptor<SFlat, STRIGGERS, SSTATES> Transitions[] =
+	{
+		{ SSTATES::S1, STRIGGERS::T, &SFlat::S1TTriggerGuard, SSTATES::S2 }
+	};
+};
@@ -0,0 +1,66 @@
+/*
+ * SStatic.cpp:
+ *	Base classes to support a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#include "SStatic.h"
+#include <stdio.h>
+
+void S11Static::ExitAction()
+{
+	printf("a() : ");
+}
+
+S1Static::S1Static()
+{
+	AddTriggerGuard(STRIGGERS::T, &S1Static::TTriggerGuard);
+}
+
+void S1Static::TTriggerGuard(STRIGGERS trigger, Transition<S1Static, SSTATES>& transition)
+{
+	printf("g() : ");
+	transition.TargetState = SSTATES::S2;
+	transition.Actions = &S1Static::TTransition;
+}
+
+void S1Static::TTransition()
+{
+	printf("t() : ");
+}
+
+void S1Static::ExitAction()
+{
+	// order is important here. According to UML the child state
+	// needs to exit first so call the base class first.
+	StaticOrState::ExitAction();
+
+	printf("b() : ");
+}
+
+void S21Static::EntryAction()
+{
+	printf("e() : ");
+}
+
+void S2Static::EntryAction()
+{
+	printf("c() : ");
+	StaticOrState::EntryAction();
+}
@@ -0,0 +1,87 @@
+/*
+ * SStatic.h:
+ *	Base classes to support a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include "../StaticStateMachine.h"
+#include "SStatesTriggers.h"
+
+// Same state chart as S but built from the static state classes so
+// every entry, exit and trigger call is resolved at compile time.
+class S11Static : public StaticStateTemplate<S11Static,
+	STRIGGERS,
+	(int)STRIGGERS::Count,
+	SSTATES,
+	SSTATES::S11>
+{
+public:
+	void ExitAction();
+};
+
+class S1Static : public StaticOrState<S1Static,
+	STRIGGERS,
+	(int)STRIGGERS::Count,
+	SSTATES,
+	SSTATES::S1,
+	SSTATES::S11,
+	Children<S11Static>>
+{
+	void TTriggerGuard(STRIGGERS trigger, Transition<S1Static, SSTATES>& transition);
+	void TTransition();
+
+public:
+	S1Static();
+
+	void ExitAction();
+};
+
+class S21Static : public StaticStateTemplate<S21Static,
+	STRIGGERS,
+	(int)STRIGGERS::Count,
+	SSTATES,
+	SSTATES::S21>
+{
+public:
+	void EntryAction();
+};
+
+class S2Static : public StaticOrState<S2Static,
+	STRIGGERS,
+	(int)STRIGGERS::Count,
+	SSTATES,
+	SSTATES::S2,
+	SSTATES::S21,
+	Children<S21Static>>
+{
+public:
+	void EntryAction();
+};
+
+class SStatic : public StaticOrState<SStatic,
+	STRIGGERS,
+	(int)STRIGGERS::Count,
+	SSTATES,
+	SSTATES::S,
+	SSTATES::S1,
+	Children<S1Static, S2Static>>
+{
+};
@@ -24,11 +24,9 @@
 #include "S1.h"
 #include "S2.h"
 
-S::S()
+S::S(StateArena* arena) :
+	OrState(arena)
 {
-	S1* s1 = new S1();
-	S2* s2 = new S2();
-
-	AddState(SSTATES::S1, s1);
-	AddState(SSTATES::S2, s2);
+	CreateState<S1>(SSTATES::S1, arena);
+	CreateState<S2>(SSTATES::S2, arena);
 }
\ No newline at end of file
@@ -29,8 +29,10 @@ class S : public OrState<S,
 	(int)STRIGGERS::Count,
 	SSTATES,
 	(int)SSTATES::Count,
-	SSTATES::S1>
+	SSTATES::S1,
+	2,
+	0>
 {
 public:
-	S();
+	S(StateArena* arena = nullptr);
 };
\ No newline at end of file
@@ -25,10 +25,5 @@
 
 Final::Final()
 {
-	AddTriggerGuard(TRIGGERS::IDLETRIGGER, &Final::IdleTriggerGuard);
-}
-
-void Final::IdleTriggerGuard(TRIGGERS trigger, Transition<Final, STATES>& transition)
-{
-	transition.TargetState = STATES::IDLE;
+	AddTransition(TRIGGERS::IDLETRIGGER, STATES::IDLE);
 }
\ No newline at end of file
@@ -28,11 +28,10 @@
 class Final : public StateTemplate<Final,
 	TRIGGERS,
 	(int)TRIGGERS::Count,
-	STATES>
+	STATES,
+	1,    // guards
+	1>    // transitions
 {
-private:
-	void IdleTriggerGuard(TRIGGERS trigger, Transition<Final, STATES> &transition);
-
 public:
 	Final();
 	void virtual EntryAction() {};
@@ -26,16 +26,6 @@
 
 Idle::Idle()
 {
-	AddTriggerGuard(TRIGGERS::IDLETRIGGER, &Idle::IdleTriggerGuard);
-	AddTriggerGuard(TRIGGERS::FINALTRIGGER, &Idle::FinalTriggerGuard);
-}
-
-void Idle::IdleTriggerGuard(TRIGGERS trigger, Transition<Idle, STATES>& transition)
-{
-	transition.TargetState = STATES::IDLE;
-}
-
-void Idle::FinalTriggerGuard(TRIGGERS trigger, Transition<Idle, STATES>& transition)
-{
-	transition.TargetState = STATES::FINAL;
+	AddTransition(TRIGGERS::IDLETRIGGER, STATES::IDLE);
+	AddTransition(TRIGGERS::FINALTRIGGER, STATES::FINAL);
 }
\ No newline at end of file
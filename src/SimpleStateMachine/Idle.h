@@ -27,12 +27,10 @@
 class Idle : public StateTemplate<Idle,
 	TRIGGERS,
 	(int)TRIGGERS::Count,
-	STATES>
+	STATES,
+	2,    // guards
+	2>    // transitions
 {
-private:
-	void IdleTriggerGuard(TRIGGERS trigger, Transition<Idle, STATES>& transition);
-	void FinalTriggerGuard(TRIGGERS trigger, Transition<Idle, STATES>& transition);
-
 public:
 	Idle();
 	void virtual EntryAction() {};
@@ -22,6 +22,15 @@
 */
 #pragma once
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 // These reserved defines must be define in the enumeration that
 // defines the state for your own state machine. NO_STATE is
 // the value the state mcahines's current state member field is
@@ -55,240 +64,1861 @@
 #define RESERVED_TRIGGER_DEFAULT_ENTRY -1
 #define RESERVED_TRIGGER_DEFAULT_EXIT -2
 
-template<typename EnumState, typename EnumTrigger>
-class State
+// StateArena provides the memory for all the states of a machine
+// hierarchy from one contiguous block.  The block is either owned
+// by the arena (one heap allocation) or supplied by the caller, for
+// example a buffer on the stack or inside another object.  States
+// created through OrState::CreateState with an arena are placement
+// constructed into the block so building a machine costs at most
+// one allocation and releasing the block is O(1).  The arena must
+// outlive every machine built from it.  Allocations are aligned by
+// their address, so a caller supplied buffer needs no particular
+// alignment; SizeFor() leaves room for the padding.
+class StateArena
 {
+private:
+	char* _buffer;
+	size_t _capacity;
+	size_t _used;
+	bool _ownsBuffer;
+
 public:
-	virtual ~State() {};
-	virtual void EntryAction()  = 0;
-	virtual void EntryAction(EnumState& triggerless) = 0;
-	virtual void ExitAction() = 0;
-	EnumState virtual Trigger(EnumTrigger trigger) = 0;
-	virtual void TransitionActions() = 0;
-};
+	StateArena(size_t capacity) :
+		_buffer(new char[capacity]),
+		_capacity(capacity),
+		_used(0),
+		_ownsBuffer(true)
+	{
+	}
+
+	StateArena(void* buffer, size_t capacity) :
+		_buffer((char*)buffer),
+		_capacity(capacity),
+		_used(0),
+		_ownsBuffer(false)
+	{
+	}
 
+	StateArena(const StateArena&) = delete;
+	StateArena& operator=(const StateArena&) = delete;
 
-template <class T, typename EnumState>
-struct Transition
+	~StateArena()
+	{
+		if (_ownsBuffer)
+		{
+			delete[] _buffer;
+		}
+	}
+
+	// Returns nullptr when the arena is exhausted.  alignment must be
+	// a power of two.
+	void* Allocate(size_t size, size_t alignment)
+	{
+		uintptr_t base = (uintptr_t)_buffer;
+		size_t offset = (size_t)(((base + _used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+
+		if (offset + size > _capacity)
+		{
+			return nullptr;
+		}
+
+		_used = offset + size;
+		return _buffer + offset;
+	}
+
+	bool Owns(const void* pointer) const
+	{
+		return pointer >= _buffer && pointer < _buffer + _capacity;
+	}
+
+	// Only valid once every state in the arena has been destroyed.
+	void Reset() { _used = 0; }
+
+	size_t GetUsed() const { return _used; }
+	size_t GetCapacity() const { return _capacity; }
+
+	// Upper bound on the arena size needed for one instance of
+	// each of the given state types.
+	template <class... States>
+	static constexpr size_t SizeFor()
+	{
+		return ((sizeof(States) + alignof(States) - 1) + ... + 0);
+	}
+};
+
+// StateTable maps the values of a state or trigger enumeration to
+// pointers or targets, with nullptr for values that were never set.  When
+// numEntries equals numKeys the table is a dense array indexed by
+// the enumeration value.  A smaller numEntries chosen at compile
+// time stores only that many entries, sorted by key, which keeps
+// composites with few children and states with few guards small
+// in machines with hundreds of states and triggers.  The sorted
+// form is only used when it is smaller than the dense array.
+template <typename Key, typename Value, int numKeys, int numEntries = numKeys,
+	bool sparse = (numEntries * (sizeof(Value) + sizeof(short)) + sizeof(short) < numKeys * sizeof(Value))>
+class StateTable
 {
-	EnumState TargetState;	
+private:
+	short _keys[numEntries];
+	Value _values[numEntries];
+	short _count;
 
-	typedef void (T::* TransitionAction)();
-	TransitionAction Actions;
+public:
+	StateTable() :
+		_count(0)
+	{
+	}
 
-	Transition() :
-		TargetState(EnumState::NOSTATE),
-		Actions(nullptr)
+	Value Find(Key key) const
 	{
+		int low = 0;
+		int high = _count - 1;
+
+		while (low <= high)
+		{
+			int middle = (low + high) / 2;
+
+			if (_keys[middle] < (short)key)
+			{
+				low = middle + 1;
+			}
+			else if (_keys[middle] > (short)key)
+			{
+				high = middle - 1;
+			}
+			else
+			{
+				return _values[middle];
+			}
+		}
+		return nullptr;
 	}
 
-	Transition(EnumState targetState) :
-		TargetState(targetState),
-		Actions(nullptr)
+	// Whether Set() would accept the key.
+	bool CanSet(Key key) const
 	{
+		if (_count < numEntries)
+		{
+			return true;
+		}
+
+		for (int i = 0; i < _count; i++)
+		{
+			if (_keys[i] == (short)key)
+			{
+				return true;
+			}
+		}
+		return false;
 	}
 
-	void Action(T* stateInstance)
+	// Returns false, leaving the table unchanged, when a new key
+	// does not fit.
+	bool Set(Key key, Value value)
 	{
-		if (Actions != nullptr)
+		int i = 0;
+		while (i < _count && _keys[i] < (short)key)
 		{
-			(stateInstance->*Actions)();
+			i++;
+		}
+
+		if (i < _count && _keys[i] == (short)key)
+		{
+			_values[i] = value;
+			return true;
+		}
+
+		if (_count >= numEntries)
+		{
+			return false;
 		}
+
+		for (int j = _count; j > i; j--)
+		{
+			_keys[j] = _keys[j - 1];
+			_values[j] = _values[j - 1];
+		}
+		_keys[i] = (short)key;
+		_values[i] = value;
+		_count++;
+		return true;
 	}
 
+	int GetCount() const { return _count; }
+	Value GetValue(int index) const { return _values[index]; }
 };
 
-template <class T, typename EnumTrigger, int countTriggers, typename EnumState>
-class StateTemplate : public State<EnumState, EnumTrigger>
+template <typename Key, typename Value, int numKeys>
+class StateTable<Key, Value, numKeys, 0, true>
 {
-protected:	
-	typedef void (T::* Guard)(EnumTrigger, Transition<T, EnumState>&);
-	Guard _triggers[countTriggers];
-	Transition<T, EnumState> _transition;
+public:
+	Value Find(Key key) const { return nullptr; }
+	bool CanSet(Key key) const { return false; }
+
+	bool Set(Key key, Value value)
+	{
+		return false;
+	}
+
+	int GetCount() const { return 0; }
+	Value GetValue(int index) const { return nullptr; }
+};
+
+template <typename Key, typename Value, int numKeys, int numEntries>
+class StateTable<Key, Value, numKeys, numEntries, false>
+{
+private:
+	Value _values[numKeys];
 
 public:
-	StateTemplate()
+	StateTable()
 	{
-		for (int i = 0; i < countTriggers; i++)
+		for (int i = 0; i < numKeys; i++)
 		{
-			_triggers[i] = nullptr;
+			_values[i] = nullptr;
 		}
 	}
 
-	void EntryAction(EnumState& triggerless) override
+	Value Find(Key key) const { return _values[(int)key]; }
+	bool CanSet(Key key) const { return true; }
+	bool Set(Key key, Value value)
 	{
-		EntryAction();
-		triggerless = EnumState::NOSTATECHANGE;
+		_values[(int)key] = value;
+		return true;
 	}
 
-	void EntryAction() override
+	int GetCount() const { return numKeys; }
+	Value GetValue(int index) const { return _values[index]; }
+};
+
+// Triggers carry no data unless TriggerTraits is specialized for
+// the trigger enumeration with a Payload type:
+//
+// struct KeyPayload { char Key; };
+//
+// template <>
+// struct TriggerTraits<YOURTRIGGERS>
+// {
+//	typedef KeyPayload Payload;
+// };
+//
+// The payload then travels with the trigger in a TriggerEvent and
+// is passed by value to every guard of the machine, whose signature
+// becomes (trigger, payload, transition).
+struct NoPayload
+{
+};
+
+template <typename EnumTrigger>
+struct TriggerTraits
+{
+	typedef NoPayload Payload;
+};
+
+template <typename EnumTrigger>
+struct TriggerEvent
+{
+	typedef typename TriggerTraits<EnumTrigger>::Payload Payload;
+
+	static_assert(std::is_trivially_copyable<Payload>::value, "Trigger payloads must be trivially copyable");
+	static_assert(sizeof(Payload) + sizeof(EnumTrigger) <= 64, "Trigger events should fit in a cache line");
+
+	EnumTrigger Trigger;
+	Payload Data;
+};
+
+// DeferredTriggerQueue parks the triggers deferred by the states of
+// one machine until the machine leaves a state, and then re-posts
+// them in the order they arrived.  The ring is allocated once when
+// the queue is constructed, so deferring a trigger never allocates.
+// A trigger that arrives while the ring is full is dropped and
+// counted.  OrState::SetDeferredQueue() attaches a queue to a
+// machine; the queue must outlive it.
+template <typename EnumTrigger>
+class DeferredTriggerQueue
+{
+private:
+	std::vector<TriggerEvent<EnumTrigger>> _events;
+	size_t _mask;
+	size_t _head = 0;
+	size_t _count = 0;
+	size_t _dropped = 0;
+	bool _dispatching = false;
+	bool _parked = false;
+	bool _parkDropped = false;
+	bool _consumed = false;
+	bool _recall = false;
+
+public:
+	// The capacity is rounded up to a power of two.
+	DeferredTriggerQueue(size_t capacity)
 	{
-//		State<EnumState>::EntryAction();
+		size_t size = 1;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		_events.resize(size);
+		_mask = size - 1;
 	}
 
-	void ExitAction() override
-	{
+	size_t GetCount() const { return _count; }
+	size_t GetCapacity() const { return _events.size(); }
+	size_t GetDropped() const { return _dropped; }
+	bool IsEmpty() const { return _count == 0; }
 
+	void Clear()
+	{
+		_head = 0;
+		_count = 0;
+		_recall = false;
 	}
-	
-	EnumState Trigger(EnumTrigger trigger) override
+
+	// Parks the trigger being processed, once however many states
+	// defer it.  The event counts as consumed even when the ring is
+	// full, so no other state of the machine sees it.
+	void Park(const TriggerEvent<EnumTrigger>& event)
 	{
-		switch(trigger)
+		if (_parked)
 		{
-		case EnumTrigger::DEFAULTENTRY:
-		{
-			_transition.Actions = nullptr;
+			return;
 		}
-		// fall through...
-		case EnumTrigger::DEFAULTEXIT:
+		_parked = true;
+		_parkDropped = _count == _events.size();
+		if (_parkDropped)
 		{
-			_transition.TargetState = EnumState::NOSTATE;
-			
+			_dropped++;
+			return;
 		}
-		break;
-		default:
-		{
-			Guard guard = _triggers[(int) trigger];
+		_events[(_head + _count++) & _mask] = event;
+	}
 
-			_transition.Actions = nullptr;
-			if (guard == nullptr)
+	TriggerEvent<EnumTrigger> Pop()
+	{
+		TriggerEvent<EnumTrigger> event = _events[_head];
+		_head = (_head + 1) & _mask;
+		_count--;
+		return event;
+	}
+
+	// Called whenever a state of the machine is exited.  The trigger
+	// being processed has then been consumed by a transition, so it
+	// is not deferred, and is taken back out of the ring when an
+	// orthogonal region parked it first.
+	void StateExited()
+	{
+		if (_parked)
+		{
+			_parked = false;
+			if (_parkDropped)
 			{
-				_transition.TargetState = EnumState::NOSTATECHANGE;
+				_dropped--;
 			}
 			else
 			{
-				((T*)this->*guard)(trigger, _transition);
+				_count--;
 			}
 		}
-		break;
-		}
-
-		return _transition.TargetState;
+		_consumed = true;
+		_recall |= _count != 0;
 	}
 
-	void TransitionActions() override	
+	bool TakeRecall()
 	{
-		_transition.Action((T*) this);
+		bool recall = _recall;
+		_recall = false;
+		return recall;
 	}
 
-	void AddTriggerGuard(EnumTrigger trigger, Guard guard)
+	// True while the machine that owns the queue processes a trigger.
+	// Only the outermost Trigger() re-posts parked triggers.
+	bool IsDispatching() const { return _dispatching; }
+	void SetDispatching(bool dispatching) { _dispatching = dispatching; }
+
+	// Whether the trigger being processed has been parked, or has
+	// made a state of the machine exit.
+	bool WasParked() const { return _parked; }
+	bool WasConsumed() const { return _consumed; }
+
+	// Called before each trigger the machine processes.
+	void StartTrigger()
 	{
-		_triggers[(int) trigger] = guard;
+		_parked = false;
+		_consumed = false;
 	}
 };
 
-template <class T, typename EnumTrigger, int numTriggers, typename EnumState, int numStates, EnumState defaultEntryState>
-class OrState : public StateTemplate<T, EnumTrigger, numTriggers, EnumState>
+// SnapshotWriter appends the configuration of machines to a byte
+// buffer and SnapshotReader reads it back in the same order.  The
+// active state of every OrState is written as a varint, so a machine
+// with fewer than 127 states takes a byte per composite.  States
+// with data of their own, or machines with a model, override Save()
+// and Restore() to add it after the configuration.
+class SnapshotWriter
 {
-
 private:
-	State<EnumState, EnumTrigger>* _childStates[numStates];
-	EnumState _defaultEntryState = defaultEntryState;
-	EnumState _currentState = EnumState::NOSTATE;
+	std::vector<unsigned char>& _buffer;
 
-	void ChangeState(EnumState newState)
+public:
+	SnapshotWriter(std::vector<unsigned char>& buffer) :
+		_buffer(buffer)
 	{
-		if (newState == EnumState::NOSTATECHANGE)
-		{
-			return;
-		}
-
-		if (_currentState != EnumState::NOSTATE)
-		{
-			State<EnumState, EnumTrigger>* stateInstance = _childStates[(int)_currentState];
+	}
 
-			stateInstance->ExitAction();
-			stateInstance->TransitionActions();
-		}
+	void Reserve(size_t bytes) { _buffer.reserve(_buffer.size() + bytes); }
+	size_t GetSize() const { return _buffer.size(); }
 
-		if (newState == EnumState::NOSTATE)
+	void WriteVarint(uint64_t value)
+	{
+		while (value >= 0x80)
 		{
-			_currentState = EnumState::NOSTATE;
+			_buffer.push_back((unsigned char)(value | 0x80));
+			value >>= 7;
 		}
-		else
-		{
-			_currentState = newState;
+		_buffer.push_back((unsigned char)value);
+	}
 
-			EnumState triggerless;
-			State<EnumState, EnumTrigger>* stateInstance = _childStates[(int)_currentState];
-			stateInstance->EntryAction(triggerless);
+	template <typename V>
+	void Write(const V& value)
+	{
+		static_assert(std::is_trivially_copyable<V>::value, "Snapshot values must be trivially copyable");
 
-			ChangeState(triggerless);
-		}
+		size_t size = _buffer.size();
+		_buffer.resize(size + sizeof(V));
+		memcpy(_buffer.data() + size, &value, sizeof(V));
 	}
+};
+
+// Reading past the end or an out of range state marks the reader
+// invalid, after which it only returns zeros.
+class SnapshotReader
+{
+private:
+	const unsigned char* _data;
+	const unsigned char* _end;
+	bool _valid = true;
 
 public:
-	OrState()
+	SnapshotReader(const unsigned char* data, size_t size) :
+		_data(data),
+		_end(data + size)
+	{
+	}
+
+	SnapshotReader(const std::vector<unsigned char>& buffer) :
+		SnapshotReader(buffer.data(), buffer.size())
+	{
+	}
+
+	bool IsValid() const { return _valid; }
+	size_t GetRemaining() const { return _end - _data; }
+
+	void Fail()
+	{
+		_valid = false;
+		_data = _end;
+	}
+
+	uint64_t ReadVarint()
 	{
-		for (int i = 0; i < numStates; i++)
+		uint64_t value = 0;
+
+		for (int shift = 0; shift < 64; shift += 7)
 		{
-			_childStates[i] = nullptr;
+			if (_data == _end)
+			{
+				break;
+			}
+
+			unsigned char byte = *_data++;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return value;
+			}
 		}
+
+		Fail();
+		return 0;
 	}
 
-	~OrState() override
+	template <typename V>
+	V Read()
 	{
-		for (int i = 0; i < numStates; i++)
+		static_assert(std::is_trivially_copyable<V>::value, "Snapshot values must be trivially copyable");
+
+		V value{};
+		if (GetRemaining() < sizeof(V))
 		{
-			State<EnumState, EnumTrigger>* pState = _childStates[i];
+			Fail();
+			return value;
+		}
 
-			if (pState == nullptr)
-				continue;
+		memcpy(&value, _data, sizeof(V));
+		_data += sizeof(V);
+		return value;
+	}
 
-			delete pState;
+	// Reads a state written by WriteState, NOSTATE included.
+	template <typename EnumState>
+	EnumState ReadState(int stateCount)
+	{
+		uint64_t value = ReadVarint();
+		if (value > (uint64_t)stateCount)
+		{
+			Fail();
+			return EnumState::NOSTATE;
 		}
+		return (EnumState)((int)value - 1);
 	}
-	
-	void AddState(EnumState enumValue, State<EnumState, EnumTrigger>* instance)
-	{		
-		_childStates[(int) enumValue] = instance;
-	}
+};
 
-	void EntryAction() override
-	{		
-		Trigger(EnumTrigger::DEFAULTENTRY);
+template <typename EnumState>
+void WriteState(SnapshotWriter& writer, EnumState state)
+{
+	writer.WriteVarint((uint64_t)((int)state + 1));
+}
+
+// Snapshots of many machines are packed back to back into one
+// buffer and restored in the same order.  Machine is any machine
+// with Save() and Restore(), such as an OrState, AndState or
+// FlatStateMachine, in a contiguous array or through pointers.
+template <class Machine>
+void SaveSnapshots(const Machine* machines, size_t count, SnapshotWriter& writer)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		machines[i].Save(writer);
 	}
+}
 
-	void ExitAction() override
-	{		
-		Trigger(EnumTrigger::DEFAULTEXIT);
+template <class Machine>
+void SaveSnapshots(Machine* const* machines, size_t count, SnapshotWriter& writer)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		machines[i]->Save(writer);
 	}
+}
 
-	EnumState GetCurrentState() { return _currentState; }
+template <class Machine>
+bool RestoreSnapshots(Machine* machines, size_t count, SnapshotReader& reader)
+{
+	for (size_t i = 0; i < count && reader.IsValid(); i++)
+	{
+		machines[i].Restore(reader);
+	}
+	return reader.IsValid();
+}
 
-	EnumState Trigger(EnumTrigger trigger) override
+template <class Machine>
+bool RestoreSnapshots(Machine* const* machines, size_t count, SnapshotReader& reader)
+{
+	for (size_t i = 0; i < count && reader.IsValid(); i++)
 	{
-		switch (trigger)
-		{
-		case EnumTrigger::DEFAULTENTRY:
-		{
-			if (_currentState != EnumState::NOSTATE)
-			{
-				return EnumState::NOSTATECHANGE;
-			}
-			ChangeState(_defaultEntryState);
-		}
-		break;
-		case EnumTrigger::DEFAULTEXIT:
-		{			
-			ChangeState(EnumState::NOSTATE);
-		}
-		break;
-		default:
-		{
-			if (_currentState != EnumState::NOSTATE)
-			{	
-				State<EnumState, EnumTrigger>* stateInstance;
-				stateInstance = _childStates[(int)_currentState];
+		machines[i]->Restore(reader);
+	}
+	return reader.IsValid();
+}
 
-				EnumState targetState = stateInstance->Trigger(trigger);				 
+template<typename EnumState, typename EnumTrigger>
+class State
+{
+public:
+	typedef EnumState StateType;
+	typedef EnumTrigger TriggerType;
+
+	virtual ~State() {};
+	virtual void EntryAction()  = 0;
+	virtual void EntryAction(EnumState& triggerless) = 0;
 
-				ChangeState(targetState);
+	// Entry through a deep history pseudostate: as EntryAction(), and
+	// a composite resumes the configuration it had when it last
+	// exited instead of its default entry.
+	virtual void HistoryEntryAction(EnumState& triggerless) = 0;
+	virtual void ExitAction() = 0;
+	EnumState virtual Trigger(EnumTrigger trigger) = 0;
+	EnumState virtual Trigger(TriggerEvent<EnumTrigger> event) = 0;
+	virtual void TransitionActions() = 0;
+
+	// Writes the configuration below and including this state, and
+	// restores it without running entry or exit actions.
+	virtual void Save(SnapshotWriter& writer) const = 0;
+	virtual void Restore(SnapshotReader& reader) = 0;
+
+	// Leaves this state and every state below it inactive and without
+	// history, without running exit actions.  A Restore() that fails
+	// does this so no part of the snapshot stays applied.
+	virtual void Deactivate() = 0;
+
+	// Set while a Journal replays triggers into the machine, so that
+	// actions can skip side effects outside the machine.
+	virtual void SetReplayMode(bool replayMode) = 0;
+
+	// The queue deferred triggers are parked in, nullptr when the
+	// machine does not defer triggers.
+	virtual void SetDeferredQueue(DeferredTriggerQueue<EnumTrigger>* queue) = 0;
+
+	// Bit mask of the triggers that this state or any state below it
+	// has a guard, transition or deferral for.  A composite skips the
+	// subtree of an active child whose mask does not have a trigger.
+	// Masks only grow and a state adds its triggers to its parent's.
+	virtual const unsigned char* GetHandledTriggers() const = 0;
+	virtual void AddHandledTrigger(EnumTrigger trigger) = 0;
+	virtual void SetParent(State<EnumState, EnumTrigger>* parent) = 0;
+};
+
+// Tests a trigger in a mask from State::GetHandledTriggers().
+template <typename EnumTrigger>
+inline bool IsTriggerHandled(const unsigned char* handled, EnumTrigger trigger)
+{
+	return (handled[(int)trigger >> 3] & (1 << ((int)trigger & 7))) != 0;
+}
+
+
+// InlineAction holds a callable taking no arguments, typically a
+// lambda, in a fixed buffer inside the object so that setting it
+// never allocates.  The callable must fit in the buffer and be
+// trivially copyable and destructible, which lambdas capturing
+// pointers and plain values are:
+//
+//	transition.Closure = [this, key]() { _stateModel.SetPressedKey(key); };
+template <size_t capacity = 2 * sizeof(void*)>
+class InlineAction
+{
+private:
+	alignas(void*) unsigned char _storage[capacity];
+	void (*_invoke)(const void* storage) = nullptr;
+
+public:
+	InlineAction()
+	{
+	}
+
+	template <typename Function>
+	InlineAction& operator=(Function function)
+	{
+		static_assert(sizeof(Function) <= capacity, "Callable does not fit in the InlineAction buffer");
+		static_assert(alignof(Function) <= alignof(void*), "Callable alignment too large for InlineAction");
+		static_assert(std::is_trivially_copyable<Function>::value && std::is_trivially_destructible<Function>::value,
+			"InlineAction needs a trivially copyable callable");
+
+		new (_storage) Function(function);
+		_invoke = [](const void* storage) { (*(const Function*)storage)(); };
+		return *this;
+	}
+
+	void Reset() { _invoke = nullptr; }
+
+	explicit operator bool() const { return _invoke != nullptr; }
+
+	void operator()() const
+	{
+		if (_invoke != nullptr)
+		{
+			_invoke(_storage);
+		}
+	}
+};
+
+template <class T, typename EnumState>
+struct Transition
+{
+	EnumState TargetState;	
+
+	typedef void (T::* TransitionAction)();
+	TransitionAction Actions;
+
+	// Runs after Actions.  Unlike Actions it can carry context from
+	// the guard, such as the trigger's data, without allocating.
+	InlineAction<> Closure;
+
+	Transition() :
+		TargetState(EnumState::NOSTATE),
+		Actions(nullptr)
+	{
+	}
+
+	Transition(EnumState targetState) :
+		TargetState(targetState),
+		Actions(nullptr)
+	{
+	}
+
+	void ClearActions()
+	{
+		Actions = nullptr;
+		Closure.Reset();
+	}
+
+	void Action(T* stateInstance)
+	{
+		if (Actions != nullptr)
+		{
+			(stateInstance->*Actions)();
+		}
+		Closure();
+	}
+
+};
+
+// Result of OrState::TriggerBatch().  Consumed is the number of
+// triggers processed.  The batch stops early when the machine has
+// left all of its states or when a guard of the composite itself
+// asks its enclosing state for a transition, which is then reported
+// in TargetState.
+template <typename EnumState>
+struct TriggerBatchResult
+{
+	size_t Consumed;
+	EnumState CurrentState;
+	EnumState TargetState;
+};
+
+template <class T, typename EnumTrigger, typename EnumState, typename Payload = typename TriggerTraits<EnumTrigger>::Payload>
+struct GuardType
+{
+	typedef void (T::* Type)(EnumTrigger, Payload, Transition<T, EnumState>&);
+};
+
+template <class T, typename EnumTrigger, typename EnumState>
+struct GuardType<T, EnumTrigger, EnumState, NoPayload>
+{
+	typedef void (T::* Type)(EnumTrigger, Transition<T, EnumState>&);
+};
+
+// Target of an unconditional transition, NOSTATECHANGE for a
+// trigger without one.
+template <typename EnumState>
+struct TransitionTarget
+{
+	EnumState State;
+
+	TransitionTarget(std::nullptr_t = nullptr) :
+		State(EnumState::NOSTATECHANGE)
+	{
+	}
+
+	TransitionTarget(EnumState state) :
+		State(state)
+	{
+	}
+};
+
+template <class T, typename EnumTrigger, int countTriggers, typename EnumState, int numGuards = countTriggers, int numTransitions = 0>
+class StateTemplate : public State<EnumState, EnumTrigger>
+{
+protected:	
+	typedef typename GuardType<T, EnumTrigger, EnumState>::Type Guard;
+	typedef typename TriggerEvent<EnumTrigger>::Payload Payload;
+	StateTable<EnumTrigger, Guard, countTriggers, numGuards> _triggers;
+	Transition<T, EnumState> _transition;
+	bool _replayMode = false;
+	StateTable<EnumTrigger, TransitionTarget<EnumState>, countTriggers, numTransitions> _targets;
+	unsigned char _deferredTriggers[(countTriggers + 7) / 8] = {};
+	DeferredTriggerQueue<EnumTrigger>* _deferredQueue = nullptr;
+	unsigned char _handledTriggers[(countTriggers + 7) / 8] = {};
+	State<EnumState, EnumTrigger>* _parent = nullptr;
+
+public:
+	StateTemplate()
+	{
+	}
+
+	// True while the machine is replayed from a Journal.  Actions
+	// that write output or talk to other systems skip that work in
+	// replay mode; changes to the model are still made.
+	bool IsReplayMode() const { return _replayMode; }
+
+	void SetReplayMode(bool replayMode) override
+	{
+		_replayMode = replayMode;
+	}
+
+	void SetDeferredQueue(DeferredTriggerQueue<EnumTrigger>* queue) override
+	{
+		_deferredQueue = queue;
+	}
+
+	const unsigned char* GetHandledTriggers() const override
+	{
+		return _handledTriggers;
+	}
+
+	void AddHandledTrigger(EnumTrigger trigger) override
+	{
+		if (IsTriggerHandled(_handledTriggers, trigger))
+		{
+			return;
+		}
+
+		_handledTriggers[(int)trigger >> 3] |= (unsigned char)(1 << ((int)trigger & 7));
+		if (_parent != nullptr)
+		{
+			_parent->AddHandledTrigger(trigger);
+		}
+	}
+
+	void SetParent(State<EnumState, EnumTrigger>* parent) override
+	{
+		_parent = parent;
+		for (int i = 0; i < countTriggers; i++)
+		{
+			if (IsTriggerHandled(_handledTriggers, (EnumTrigger)i))
+			{
+				_parent->AddHandledTrigger((EnumTrigger)i);
+			}
+		}
+	}
+
+	void EntryAction(EnumState& triggerless) override
+	{
+		EntryAction();
+		triggerless = EnumState::NOSTATECHANGE;
+	}
+
+	void HistoryEntryAction(EnumState& triggerless) override
+	{
+		this->EntryAction(triggerless);
+	}
+
+	void EntryAction() override
+	{
+//		State<EnumState>::EntryAction();
+	}
+
+	void ExitAction() override
+	{
+
+	}
+
+	void Save(SnapshotWriter& writer) const override
+	{
+	}
+
+	void Restore(SnapshotReader& reader) override
+	{
+	}
+
+	void Deactivate() override
+	{
+	}
+	
+	EnumState Trigger(EnumTrigger trigger) override
+	{
+		return EvaluateGuard({ trigger });
+	}
+
+	EnumState Trigger(TriggerEvent<EnumTrigger> event) override
+	{
+		return EvaluateGuard(event);
+	}
+
+	// The actions are cleared once they have run.  A state whose
+	// guards are skipped for triggers it does not handle must not run
+	// them again when its parent later leaves it.
+	void TransitionActions() override	
+	{
+		_transition.Action((T*) this);
+		_transition.ClearActions();
+	}
+
+	// Returns false when the guard table is full.
+	bool AddTriggerGuard(EnumTrigger trigger, Guard guard)
+	{
+		if (!_triggers.Set(trigger, guard))
+		{
+			assert(false && "Guard table is full; raise numGuards");
+			return false;
+		}
+		AddHandledTrigger(trigger);
+		return true;
+	}
+
+	// An unconditional transition to target.  It takes a slot of the
+	// guard table like a guard and a slot of the numTransitions
+	// entries of the target table, but is resolved without calling
+	// into the state.  Use a guard when the transition has a
+	// condition or actions.
+	bool AddTransition(EnumTrigger trigger, EnumState target)
+	{
+		assert(target != EnumState::NOSTATECHANGE && "A transition needs a target");
+
+		// Both tables are checked first, so a full one leaves neither
+		// changed.
+		if (!_targets.CanSet(trigger))
+		{
+			assert(false && "Transition table is full; raise numTransitions");
+			return false;
+		}
+		if (!_triggers.CanSet(trigger))
+		{
+			assert(false && "Guard table is full; raise numGuards");
+			return false;
+		}
+
+		_targets.Set(trigger, target);
+		_triggers.Set(trigger, ConstantTransitionGuard());
+		AddHandledTrigger(trigger);
+		return true;
+	}
+
+	// A deferred trigger that has no guard or transition in this
+	// state is parked while the state is active and re-posted once
+	// the machine has left a state.  A guard or transition for the
+	// same trigger takes precedence.
+	void AddDeferredTrigger(EnumTrigger trigger)
+	{
+		_deferredTriggers[(int)trigger >> 3] |= (unsigned char)(1 << ((int)trigger & 7));
+		AddHandledTrigger(trigger);
+	}
+
+	bool IsDeferred(EnumTrigger trigger) const
+	{
+		return (_deferredTriggers[(int)trigger >> 3] & (1 << ((int)trigger & 7))) != 0;
+	}
+
+protected:
+	// Stands in the guard table for every transition added with
+	// AddTransition().  EvaluateGuard() recognizes it and reads the
+	// target itself, so it is only ever compared against.
+	void ConstantTransition(EnumTrigger trigger, Transition<T, EnumState>& transition)
+	{
+		transition.TargetState = _targets.Find(trigger).State;
+	}
+
+	void ConstantTransition(EnumTrigger trigger, Payload, Transition<T, EnumState>& transition)
+	{
+		transition.TargetState = _targets.Find(trigger).State;
+	}
+
+	static Guard ConstantTransitionGuard()
+	{
+		if constexpr (std::is_same<Payload, NoPayload>::value)
+		{
+			void (StateTemplate::* guard)(EnumTrigger, Transition<T, EnumState>&) = &StateTemplate::ConstantTransition;
+			return guard;
+		}
+		else
+		{
+			void (StateTemplate::* guard)(EnumTrigger, Payload, Transition<T, EnumState>&) = &StateTemplate::ConstantTransition;
+			return guard;
+		}
+	}
+
+	EnumState EvaluateGuard(const TriggerEvent<EnumTrigger>& event)
+	{
+		switch(event.Trigger)
+		{
+		case EnumTrigger::DEFAULTENTRY:
+		{
+			_transition.ClearActions();
+		}
+		// fall through...
+		case EnumTrigger::DEFAULTEXIT:
+		{
+			_transition.TargetState = EnumState::NOSTATE;
+			
+		}
+		break;
+		default:
+		{
+			Guard guard = _triggers.Find(event.Trigger);
+
+			_transition.ClearActions();
+			if (guard == nullptr)
+			{
+				_transition.TargetState = EnumState::NOSTATECHANGE;
+
+				// A trigger that a state below has already taken a
+				// transition for is not deferred.
+				if (_deferredQueue != nullptr && IsDeferred(event.Trigger) &&
+					!_deferredQueue->WasConsumed())
+				{
+					_deferredQueue->Park(event);
+				}
+			}
+			else if (guard == ConstantTransitionGuard())
+			{
+				_transition.TargetState = _targets.Find(event.Trigger).State;
+			}
+			else if constexpr (std::is_same<Payload, NoPayload>::value)
+			{
+				((T*)this->*guard)(event.Trigger, _transition);
+			}
+			else
+			{
+				((T*)this->*guard)(event.Trigger, event.Data, _transition);
+			}
+		}
+		break;
+		}
+
+		return _transition.TargetState;
+	}
+};
+
+// Tracing policy that records nothing.  Its hooks are empty inline
+// functions so tracing compiles away entirely.  TracePolicy.h has
+// an active policy and lists the hooks a policy provides.
+struct NullTracePolicy
+{
+	template <typename EnumState, typename EnumTrigger>
+	static void TriggerReceived(const void*, EnumState, EnumTrigger) {}
+
+	template <typename EnumState, typename EnumTrigger>
+	static void GuardEvaluated(const void*, EnumState, EnumTrigger, EnumState) {}
+
+	template <typename EnumState>
+	static void Exit(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void ExitCompleted(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void TransitionAction(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void TransitionActionCompleted(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void Entry(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void EntryCompleted(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void TriggerlessHop(const void*, EnumState, EnumState) {}
+
+	template <typename EnumState>
+	static void TriggerlessCompleted(const void*, EnumState, int) {}
+
+	template <typename EnumState>
+	static void TriggerlessStopped(const void*, EnumState, EnumState, int) {}
+};
+
+// History of a composite.  Every OrState remembers its active child
+// when it exits.  With Shallow history re-entering the composite
+// resumes that child, which enters through its own default entry.
+// With Deep history every composite below resumes its remembered
+// child as well.  Entry actions still run, but none of the default
+// entries or guards of the path to the remembered configuration do.
+enum class HistoryKind
+{
+	None,
+	Shallow,
+	Deep
+};
+
+// numChildren and numGuards default to dense tables sized by the
+// state and trigger counts of the whole machine.  A composite with
+// only a few children or guards can name the actual counts so that
+// its tables only hold those entries.  TracePolicy receives the
+// trace hooks for the children of the composite.
+template <class T, typename EnumTrigger, int numTriggers, typename EnumState, int numStates, EnumState defaultEntryState, int numChildren = numStates, int numGuards = numTriggers, class TracePolicy = NullTracePolicy, int numTransitions = 0>
+class OrState : public StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions>
+{
+
+private:
+	StateTable<EnumState, State<EnumState, EnumTrigger>*, numStates, numChildren> _childStates;
+	EnumState _defaultEntryState = defaultEntryState;
+	EnumState _currentState = EnumState::NOSTATE;
+	const unsigned char* _currentHandled = nullptr;
+	EnumState _historyState = EnumState::NOSTATE;
+	HistoryKind _history = HistoryKind::None;
+	bool _resumeDeep = false;
+	int _triggerlessHopLimit = numStates;
+	StateArena* _arena;
+
+	// With resumeDeep the new state is entered through its deep
+	// history.  Triggerless hops that follow use their default entry.
+	//
+	// A child that names a triggerless target from its entry action
+	// is left for that target in the same loop, so a long chain of
+	// triggerless states takes neither stack nor a call per hop.  A
+	// chain stops in its current state when the next hop would enter
+	// a state a second time or exceed the hop limit.
+	void ChangeState(EnumState newState, bool resumeDeep = false)
+	{
+		unsigned char entered[(numStates + 7) / 8] = {};
+		int hops = 0;
+
+		while (newState != EnumState::NOSTATECHANGE)
+		{
+			if (_currentState != EnumState::NOSTATE)
+			{
+				State<EnumState, EnumTrigger>* stateInstance = _childStates.Find(_currentState);
+
+				TracePolicy::Exit(this, _currentState);
+				stateInstance->ExitAction();
+				TracePolicy::ExitCompleted(this, _currentState);
+
+				TracePolicy::TransitionAction(this, _currentState);
+				stateInstance->TransitionActions();
+				TracePolicy::TransitionActionCompleted(this, _currentState);
+
+				if (this->_deferredQueue != nullptr)
+				{
+					this->_deferredQueue->StateExited();
+				}
+			}
+
+			_currentState = newState;
+			if (newState == EnumState::NOSTATE)
+			{
+				_currentHandled = nullptr;
+				break;
+			}
+
+			EnumState triggerless;
+			State<EnumState, EnumTrigger>* stateInstance = _childStates.Find(_currentState);
+			assert(stateInstance != nullptr && "Target state was never added to this OrState");
+			_currentHandled = stateInstance->GetHandledTriggers();
+			TracePolicy::Entry(this, _currentState);
+			if (resumeDeep)
+			{
+				stateInstance->HistoryEntryAction(triggerless);
+			}
+			else
+			{
+				stateInstance->EntryAction(triggerless);
+			}
+			TracePolicy::EntryCompleted(this, _currentState);
+
+			if (triggerless == EnumState::NOSTATECHANGE)
+			{
+				break;
+			}
+
+			entered[(int)_currentState >> 3] |= (unsigned char)(1 << ((int)_currentState & 7));
+
+			if (hops == _triggerlessHopLimit ||
+				(triggerless != EnumState::NOSTATE &&
+				(entered[(int)triggerless >> 3] & (1 << ((int)triggerless & 7))) != 0))
+			{
+				TracePolicy::TriggerlessStopped(this, _currentState, triggerless, hops);
+				return;
+			}
+
+			TracePolicy::TriggerlessHop(this, _currentState, triggerless);
+			newState = triggerless;
+			resumeDeep = false;
+			hops++;
+		}
+
+		if (hops != 0)
+		{
+			TracePolicy::TriggerlessCompleted(this, _currentState, hops);
+		}
+	}
+
+	template <typename GetEvent, typename Deliver>
+	TriggerBatchResult<EnumState> TriggerBatchImpl(size_t count, GetEvent getEvent, Deliver deliver)
+	{
+		typedef StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions> Base;
+
+		// Deferred triggers need the outermost Trigger() to park and
+		// re-post them.
+		if (this->_deferredQueue != nullptr)
+		{
+			EnumState targetState = EnumState::NOSTATECHANGE;
+			size_t i = 0;
+
+			while (i < count && targetState == EnumState::NOSTATECHANGE)
+			{
+				TriggerEvent<EnumTrigger> event = getEvent(i);
+				deliver(i++);
+				targetState = Trigger(event);
+			}
+			return { i, _currentState, targetState };
+		}
+
+		// The active child is only looked up again after a state
+		// change, triggers that leave the state unchanged reuse it.
+		State<EnumState, EnumTrigger>* stateInstance = _currentState != EnumState::NOSTATE ?
+			_childStates.Find(_currentState) :
+			nullptr;
+		EnumState targetState = EnumState::NOSTATECHANGE;
+		size_t i = 0;
+
+		while (i < count)
+		{
+			TriggerEvent<EnumTrigger> event = getEvent(i);
+			EnumTrigger trigger = event.Trigger;
+
+			if (trigger == EnumTrigger::DEFAULTENTRY || trigger == EnumTrigger::DEFAULTEXIT)
+			{
+				deliver(i++);
+				Trigger(event);
+			}
+			else
+			{
+				if (stateInstance == nullptr)
+				{
+					break;
+				}
+
+				deliver(i++);
+
+				TracePolicy::TriggerReceived(this, _currentState, trigger);
+				if (!IsTriggerHandled(this->_handledTriggers, trigger))
+				{
+					TracePolicy::GuardEvaluated(this, _currentState, trigger, EnumState::NOSTATECHANGE);
+					continue;
+				}
+
+				EnumState childTarget = stateInstance->Trigger(event);
+				TracePolicy::GuardEvaluated(this, _currentState, trigger, childTarget);
+				if (childTarget == EnumState::NOSTATECHANGE)
+				{
+					targetState = Base::EvaluateGuard(event);
+					if (targetState != EnumState::NOSTATECHANGE)
+					{
+						break;
+					}
+					continue;
+				}
+
+				ChangeState(childTarget);
+
+				targetState = Base::EvaluateGuard(event);
+				if (targetState != EnumState::NOSTATECHANGE)
+				{
+					break;
+				}
+			}
+
+			stateInstance = _currentState != EnumState::NOSTATE ?
+				_childStates.Find(_currentState) :
+				nullptr;
+		}
+
+		return { i, _currentState, targetState };
+	}
+
+protected:
+	StateArena* GetArena() { return _arena; }
+
+public:
+	OrState(StateArena* arena = nullptr) :
+		_arena(arena)
+	{
+	}
+
+	~OrState() override
+	{
+		for (int i = 0; i < _childStates.GetCount(); i++)
+		{
+			State<EnumState, EnumTrigger>* pState = _childStates.GetValue(i);
+
+			if (pState == nullptr)
+				continue;
+
+			if (_arena != nullptr && _arena->Owns(pState))
+			{
+				pState->~State();
+			}
+			else
+			{
+				delete pState;
+			}
+		}
+	}
+	
+	// Takes ownership of the state.  Returns false when the child
+	// table is full, the caller then keeps ownership.
+	bool AddState(EnumState enumValue, State<EnumState, EnumTrigger>* instance)
+	{		
+		if (!_childStates.Set(enumValue, instance))
+		{
+			assert(false && "Child table is full; raise numChildren");
+			return false;
+		}
+		instance->SetParent(this);
+		return true;
+	}
+
+	// Creates and adds a child state.  With an arena the state is
+	// placement constructed into it, falling back to the heap when
+	// the arena is exhausted.  Returns nullptr when the child table
+	// is full.
+	template <class TState, typename... Args>
+	TState* CreateState(EnumState enumValue, Args&&... args)
+	{
+		void* memory = nullptr;
+
+		if (_arena != nullptr)
+		{
+			memory = _arena->Allocate(sizeof(TState), alignof(TState));
+		}
+
+		TState* instance = memory != nullptr ?
+			new (memory) TState(std::forward<Args>(args)...) :
+			new TState(std::forward<Args>(args)...);
+
+		if (!AddState(enumValue, instance))
+		{
+			if (memory != nullptr)
+			{
+				instance->~TState();
+			}
+			else
+			{
+				delete instance;
+			}
+			return nullptr;
+		}
+		return instance;
+	}
+
+	void EntryAction() override
+	{		
+		Trigger(EnumTrigger::DEFAULTENTRY);
+	}
+
+	void ExitAction() override
+	{		
+		Trigger(EnumTrigger::DEFAULTEXIT);
+	}
+
+	EnumState GetCurrentState() { return _currentState; }
+
+	// The most triggerless hops taken after a single state change.
+	// Defaults to the state count, which only a chain that enters a
+	// state twice can reach.
+	void SetTriggerlessHopLimit(int hopLimit) { _triggerlessHopLimit = hopLimit; }
+	int GetTriggerlessHopLimit() const { return _triggerlessHopLimit; }
+
+	void SetHistory(HistoryKind history) { _history = history; }
+	HistoryKind GetHistory() const { return _history; }
+
+	// The child resumed by history, NOSTATE before the first exit.
+	EnumState GetHistoryState() const { return _historyState; }
+	void ClearHistory() { _historyState = EnumState::NOSTATE; }
+
+	void HistoryEntryAction(EnumState& triggerless) override
+	{
+		_resumeDeep = true;
+		StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions>::EntryAction(triggerless);
+		_resumeDeep = false;
+	}
+
+	// Writes the active state followed by the configuration of every
+	// child, active or not, so a restored machine has no stale
+	// configuration left in an inactive composite.
+	void Save(SnapshotWriter& writer) const override
+	{
+		WriteState(writer, _currentState);
+		WriteState(writer, _historyState);
+
+		for (int i = 0; i < _childStates.GetCount(); i++)
+		{
+			State<EnumState, EnumTrigger>* pState = _childStates.GetValue(i);
+
+			if (pState != nullptr)
+			{
+				pState->Save(writer);
+			}
+		}
+	}
+
+	void Restore(SnapshotReader& reader) override
+	{
+		_currentState = reader.ReadState<EnumState>(numStates);
+		_historyState = reader.ReadState<EnumState>(numStates);
+
+		for (int i = 0; i < _childStates.GetCount() && reader.IsValid(); i++)
+		{
+			State<EnumState, EnumTrigger>* pState = _childStates.GetValue(i);
+
+			if (pState != nullptr)
+			{
+				pState->Restore(reader);
+			}
+		}
+
+		if ((_currentState != EnumState::NOSTATE && _childStates.Find(_currentState) == nullptr) ||
+			(_historyState != EnumState::NOSTATE && _childStates.Find(_historyState) == nullptr))
+		{
+			reader.Fail();
+		}
+
+		if (!reader.IsValid())
+		{
+			Deactivate();
+			return;
+		}
+
+		_currentHandled = _currentState != EnumState::NOSTATE ?
+			_childStates.Find(_currentState)->GetHandledTriggers() :
+			nullptr;
+	}
+
+	void Deactivate() override
+	{
+		_currentState = EnumState::NOSTATE;
+		_historyState = EnumState::NOSTATE;
+		_currentHandled = nullptr;
+		_resumeDeep = false;
+
+		for (int i = 0; i < _childStates.GetCount(); i++)
+		{
+			State<EnumState, EnumTrigger>* pState = _childStates.GetValue(i);
+
+			if (pState != nullptr)
+			{
+				pState->Deactivate();
+			}
+		}
+	}
+
+	void SetReplayMode(bool replayMode) override
+	{
+		StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions>::SetReplayMode(replayMode);
+
+		for (int i = 0; i < _childStates.GetCount(); i++)
+		{
+			State<EnumState, EnumTrigger>* pState = _childStates.GetValue(i);
+
+			if (pState != nullptr)
+			{
+				pState->SetReplayMode(replayMode);
+			}
+		}
+	}
+
+	// Attaches the queue deferred triggers of every state of the
+	// machine are parked in.  Called on the outermost state, which
+	// re-posts parked triggers after the trigger that left a state
+	// has been processed.
+	void SetDeferredQueue(DeferredTriggerQueue<EnumTrigger>* queue) override
+	{
+		StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions>::SetDeferredQueue(queue);
+
+		for (int i = 0; i < _childStates.GetCount(); i++)
+		{
+			State<EnumState, EnumTrigger>* pState = _childStates.GetValue(i);
+
+			if (pState != nullptr)
+			{
+				pState->SetDeferredQueue(queue);
+			}
+		}
+	}
+
+	EnumState Trigger(EnumTrigger trigger) override
+	{
+		return OrState::Trigger(TriggerEvent<EnumTrigger>{ trigger });
+	}
+
+	EnumState Trigger(TriggerEvent<EnumTrigger> event) override
+	{
+		DeferredTriggerQueue<EnumTrigger>* queue = this->_deferredQueue;
+
+		if (queue == nullptr || queue->IsDispatching())
+		{
+			return Dispatch(event);
+		}
+
+		// Outermost trigger: process it, then re-post the parked
+		// triggers for as long as processing them leaves states.
+		// Triggers still deferred are parked again behind the others.
+		queue->SetDispatching(true);
+		queue->StartTrigger();
+		EnumState targetState = Dispatch(event);
+
+		while (queue->TakeRecall())
+		{
+			for (size_t count = queue->GetCount(); count > 0; count--)
+			{
+				queue->StartTrigger();
+				Dispatch(queue->Pop());
+			}
+		}
+		queue->SetDispatching(false);
+
+		return targetState;
+	}
+
+private:
+	EnumState Dispatch(const TriggerEvent<EnumTrigger>& event)
+	{
+		EnumTrigger trigger = event.Trigger;
+
+		switch (trigger)
+		{
+		case EnumTrigger::DEFAULTENTRY:
+		{
+			bool resumeDeep = _resumeDeep || _history == HistoryKind::Deep;
+			_resumeDeep = false;
+
+			if (_currentState != EnumState::NOSTATE)
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+
+			if ((resumeDeep || _history == HistoryKind::Shallow) && _historyState != EnumState::NOSTATE)
+			{
+				ChangeState(_historyState, resumeDeep);
+			}
+			else
+			{
+				ChangeState(_defaultEntryState, resumeDeep);
+			}
+		}
+		break;
+		case EnumTrigger::DEFAULTEXIT:
+		{			
+			if (_currentState != EnumState::NOSTATE)
+			{
+				_historyState = _currentState;
+			}
+			ChangeState(EnumState::NOSTATE);
+		}
+		break;
+		default:
+		{
+			// The active child is skipped when nothing below it
+			// handles the trigger, only this state's guard is left.
+			// The trace still shows the trigger offered to it and
+			// ignored.
+			if (_currentState != EnumState::NOSTATE)
+			{
+				TracePolicy::TriggerReceived(this, _currentState, trigger);
+				if (!IsTriggerHandled(_currentHandled, trigger))
+				{
+					TracePolicy::GuardEvaluated(this, _currentState, trigger, EnumState::NOSTATECHANGE);
+				}
+				else
+				{
+					State<EnumState, EnumTrigger>* stateInstance;
+					stateInstance = _childStates.Find(_currentState);
+
+					EnumState targetState = stateInstance->Trigger(event);
+					TracePolicy::GuardEvaluated(this, _currentState, trigger, targetState);
+
+					// A trigger parked below is not seen by this state.
+					if (this->_deferredQueue != nullptr && this->_deferredQueue->WasParked())
+					{
+						return EnumState::NOSTATECHANGE;
+					}
+
+					ChangeState(targetState);
+				}
+			}
+
+			// Nothing in this subtree handles the trigger.
+			if (!IsTriggerHandled(this->_handledTriggers, trigger))
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+		}
+		break;
+		}
+
+		return StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions>::EvaluateGuard(event);
+	}
+
+public:
+
+	// Processes a run of triggers with the same semantics as calling
+	// Trigger() for each of them, without walking back down from the
+	// composite for every trigger.
+	TriggerBatchResult<EnumState> TriggerBatch(const EnumTrigger* triggers, size_t count)
+	{
+		return TriggerBatchImpl(count,
+			[=](size_t index) { return TriggerEvent<EnumTrigger>{ triggers[index] }; },
+			[](size_t) {});
+	}
+
+	// As above for events that carry their payload with them.
+	TriggerBatchResult<EnumState> TriggerBatch(const TriggerEvent<EnumTrigger>* events, size_t count)
+	{
+		return TriggerBatchImpl(count,
+			[=](size_t index) { return events[index]; },
+			[](size_t) {});
+	}
+
+	// As above with one payload per trigger.  deliver(payload) is
+	// called just before its trigger is processed, typically to store
+	// it in the model the guards read.
+	template <typename Payload, typename Deliver>
+	TriggerBatchResult<EnumState> TriggerBatch(const EnumTrigger* triggers, const Payload* payloads, size_t count, Deliver deliver)
+	{
+		return TriggerBatchImpl(count,
+			[=](size_t index) { return TriggerEvent<EnumTrigger>{ triggers[index] }; },
+			[&](size_t index) { deliver(payloads[index]); });
+	}
+};
+
+// Runs count tasks, possibly in parallel, and returns once all of
+// them have completed.  AndState uses it to dispatch regions whose
+// guards and actions do not touch each other's data.
+// RegionWorkerPool.h has a thread pool implementation.
+class RegionDispatcher
+{
+public:
+	virtual ~RegionDispatcher() {}
+	virtual void Run(int count, void (*task)(void* context, int index), void* context) = 0;
+};
+
+// AndState is a composite whose regions are all active at the same
+// time.  Each region is typically an OrState over the same state
+// and trigger enumerations:
+//
+// YourAndState::YourAndState()
+// {
+//	AddRegion(new YourRegion1());
+//	AddRegion(new YourRegion2());
+// }
+//
+// Entering the AndState enters its regions in the order they were
+// added and exiting it exits them in reverse order.  A trigger is
+// broadcast to every region in order before the guards of the
+// AndState itself are evaluated.  As with OrState a derived class
+// that overrides EntryAction() or ExitAction() calls the AndState
+// version after its own entry action and before its own exit
+// action.
+//
+// Regions added as independent may be dispatched in parallel once
+// a RegionDispatcher is set.  The other regions are then dispatched
+// in order on the calling thread after the independent ones have
+// completed.
+template <class T, typename EnumTrigger, int numTriggers, typename EnumState, int numRegions, int numGuards = numTriggers, int numTransitions = 0>
+class AndState : public StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions>
+{
+private:
+	typedef StateTemplate<T, EnumTrigger, numTriggers, EnumState, numGuards, numTransitions> Base;
+
+	struct Broadcast
+	{
+		AndState* Owner;
+		TriggerEvent<EnumTrigger> Event;
+	};
+
+	State<EnumState, EnumTrigger>* _regions[numRegions] = {};
+	bool _independent[numRegions] = {};
+	State<EnumState, EnumTrigger>* _parallelRegions[numRegions] = {};
+	int _regionCount = 0;
+	int _parallelCount = 0;
+	bool _active = false;
+	bool _resumeDeep = false;
+	RegionDispatcher* _dispatcher = nullptr;
+
+	static void TriggerParallelRegion(void* context, int index)
+	{
+		Broadcast* broadcast = (Broadcast*)context;
+		broadcast->Owner->_parallelRegions[index]->Trigger(broadcast->Event);
+	}
+
+	void EnterRegions()
+	{
+		bool resumeDeep = _resumeDeep;
+		_resumeDeep = false;
+
+		_active = true;
+		for (int i = 0; i < _regionCount; i++)
+		{
+			if (resumeDeep)
+			{
+				EnumState triggerless;
+				_regions[i]->HistoryEntryAction(triggerless);
+			}
+			else
+			{
+				_regions[i]->EntryAction();
+			}
+		}
+	}
+
+	void ExitRegions()
+	{
+		for (int i = _regionCount - 1; i >= 0; i--)
+		{
+			_regions[i]->ExitAction();
+		}
+		_active = false;
+	}
+
+	void BroadcastTrigger(const TriggerEvent<EnumTrigger>& event)
+	{
+		// The deferred queue is shared by every region and is not
+		// thread safe, so regions with one are dispatched in order.
+		if (_dispatcher == nullptr || _parallelCount < 2 || this->_deferredQueue != nullptr)
+		{
+			for (int i = 0; i < _regionCount; i++)
+			{
+				_regions[i]->Trigger(event);
+			}
+			return;
+		}
+
+		Broadcast broadcast = { this, event };
+		_dispatcher->Run(_parallelCount, &AndState::TriggerParallelRegion, &broadcast);
+
+		for (int i = 0; i < _regionCount; i++)
+		{
+			if (!_independent[i])
+			{
+				_regions[i]->Trigger(event);
+			}
+		}
+	}
+
+public:
+	~AndState() override
+	{
+		for (int i = 0; i < _regionCount; i++)
+		{
+			delete _regions[i];
+		}
+	}
+
+	// Takes ownership of the region.
+	void AddRegion(State<EnumState, EnumTrigger>* region, bool independent = false)
+	{
+		assert(_regionCount < numRegions && "AndState is full; raise numRegions");
+
+		_independent[_regionCount] = independent;
+		_regions[_regionCount++] = region;
+		region->SetParent(this);
+		if (independent)
+		{
+			_parallelRegions[_parallelCount++] = region;
+		}
+	}
+
+	template <class TRegion>
+	TRegion* GetRegion(int index) { return static_cast<TRegion*>(_regions[index]); }
+
+	int GetRegionCount() const { return _regionCount; }
+	bool IsActive() const { return _active; }
+
+	// With a dispatcher the independent regions are dispatched in
+	// parallel, nullptr restores in order dispatch.  Regions are
+	// always dispatched in order while a deferred queue is attached.
+	void SetDispatcher(RegionDispatcher* dispatcher) { _dispatcher = dispatcher; }
+
+	void Save(SnapshotWriter& writer) const override
+	{
+		writer.Write<unsigned char>(_active ? 1 : 0);
+
+		for (int i = 0; i < _regionCount; i++)
+		{
+			_regions[i]->Save(writer);
+		}
+	}
+
+	void Restore(SnapshotReader& reader) override
+	{
+		_active = reader.Read<unsigned char>() != 0;
+
+		for (int i = 0; i < _regionCount && reader.IsValid(); i++)
+		{
+			_regions[i]->Restore(reader);
+		}
+
+		if (!reader.IsValid())
+		{
+			Deactivate();
+		}
+	}
+
+	void Deactivate() override
+	{
+		_active = false;
+
+		for (int i = 0; i < _regionCount; i++)
+		{
+			_regions[i]->Deactivate();
+		}
+	}
+
+	void SetReplayMode(bool replayMode) override
+	{
+		Base::SetReplayMode(replayMode);
+
+		for (int i = 0; i < _regionCount; i++)
+		{
+			_regions[i]->SetReplayMode(replayMode);
+		}
+	}
+
+	void SetDeferredQueue(DeferredTriggerQueue<EnumTrigger>* queue) override
+	{
+		Base::SetDeferredQueue(queue);
+
+		for (int i = 0; i < _regionCount; i++)
+		{
+			_regions[i]->SetDeferredQueue(queue);
+		}
+	}
+
+	void EntryAction() override
+	{
+		Trigger(EnumTrigger::DEFAULTENTRY);
+	}
+
+	void ExitAction() override
+	{
+		Trigger(EnumTrigger::DEFAULTEXIT);
+	}
+
+	// Deep history resumes every region.
+	void HistoryEntryAction(EnumState& triggerless) override
+	{
+		_resumeDeep = true;
+		Base::EntryAction(triggerless);
+		_resumeDeep = false;
+	}
+
+	EnumState Trigger(EnumTrigger trigger) override
+	{
+		return AndState::Trigger(TriggerEvent<EnumTrigger>{ trigger });
+	}
+
+	EnumState Trigger(TriggerEvent<EnumTrigger> event) override
+	{
+		switch (event.Trigger)
+		{
+		case EnumTrigger::DEFAULTENTRY:
+		{
+			if (_active)
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+			EnterRegions();
+		}
+		break;
+		case EnumTrigger::DEFAULTEXIT:
+		{
+			if (_active)
+			{
+				ExitRegions();
+			}
+		}
+		break;
+		default:
+		{
+			if (!IsTriggerHandled(this->_handledTriggers, event.Trigger))
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+
+			if (_active)
+			{
+				BroadcastTrigger(event);
+			}
+
+			// A trigger parked in a region is not seen by this state.
+			if (this->_deferredQueue != nullptr && this->_deferredQueue->WasParked())
+			{
+				return EnumState::NOSTATECHANGE;
 			}
 		}
 		break;
 		}
 
-		return StateTemplate<T, EnumTrigger, numTriggers, EnumState>::Trigger(trigger);
+		return Base::EvaluateGuard(event);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,261 @@
+/*
+ * StaticStateMachine.h:
+ *	Static polymorphism variant of the C++ UML state machine classes.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <tuple>
+#include <utility>
+#include "StateMachine.h"
+
+// The static state classes mirror StateTemplate and OrState but
+// without the virtual State base class.  The concrete state type T
+// is already known through the CRTP parameter, so EntryAction,
+// ExitAction, Trigger and TransitionActions are resolved at compile
+// time and can be inlined.  A composite declares its child states
+// as a type list instead of adding State pointers at run time:
+//
+// class YourState : public StaticOrState<YourState,
+//	TRIGGERS,
+//	(int)TRIGGERS::Count,
+//	STATES,
+//	STATES::YOURSTATE,
+//	STATES::YOURSTATE1,
+//	Children<YourState1, YourState2>>
+//
+// Each child type names its own state value through the id template
+// argument of StaticStateTemplate or StaticOrState.  Child states are
+// stored by value inside the composite and are constructed with the
+// same arguments as the composite.
+
+template <typename... Types>
+struct Children
+{
+};
+
+template <class T, typename EnumTrigger, int countTriggers, typename EnumState, EnumState id>
+class StaticStateTemplate
+{
+protected:
+	typedef void (T::* Guard)(EnumTrigger, Transition<T, EnumState>&);
+	Guard _triggers[countTriggers];
+	Transition<T, EnumState> _transition;
+
+public:
+	static constexpr EnumState Id = id;
+
+	StaticStateTemplate()
+	{
+		for (int i = 0; i < countTriggers; i++)
+		{
+			_triggers[i] = nullptr;
+		}
+	}
+
+	void EntryAction()
+	{
+	}
+
+	void ExitAction()
+	{
+	}
+
+	EnumState Trigger(EnumTrigger trigger)
+	{
+		switch (trigger)
+		{
+		case EnumTrigger::DEFAULTENTRY:
+		{
+			_transition.ClearActions();
+		}
+		// fall through...
+		case EnumTrigger::DEFAULTEXIT:
+		{
+			_transition.TargetState = EnumState::NOSTATE;
+		}
+		break;
+		default:
+		{
+			Guard guard = _triggers[(int)trigger];
+
+			_transition.ClearActions();
+			if (guard == nullptr)
+			{
+				_transition.TargetState = EnumState::NOSTATECHANGE;
+			}
+			else
+			{
+				(static_cast<T*>(this)->*guard)(trigger, _transition);
+			}
+		}
+		break;
+		}
+
+		return _transition.TargetState;
+	}
+
+	void TransitionActions()
+	{
+		_transition.Action(static_cast<T*>(this));
+	}
+
+	void AddTriggerGuard(EnumTrigger trigger, Guard guard)
+	{
+		_triggers[(int)trigger] = guard;
+	}
+};
+
+template <class T, typename EnumTrigger, int numTriggers, typename EnumState, EnumState id, EnumState defaultEntryState, class ChildStates>
+class StaticOrState;
+
+template <class T, typename EnumTrigger, int numTriggers, typename EnumState, EnumState id, EnumState defaultEntryState, typename... ChildStates>
+class StaticOrState<T, EnumTrigger, numTriggers, EnumState, id, defaultEntryState, Children<ChildStates...>> :
+	public StaticStateTemplate<T, EnumTrigger, numTriggers, EnumState, id>
+{
+private:
+	std::tuple<ChildStates...> _childStates;
+	EnumState _currentState = EnumState::NOSTATE;
+
+	// Calls action with the child state instance for enumValue.  The
+	// fold expands to a compare per child which the compiler turns
+	// into a switch with the child calls inlined.
+	template <class Action, std::size_t... Indices>
+	bool WithChildState(EnumState enumValue, Action&& action, std::index_sequence<Indices...>)
+	{
+		return ((std::tuple_element_t<Indices, std::tuple<ChildStates...>>::Id == enumValue ?
+			(action(std::get<Indices>(_childStates)), true) : false) || ...);
+	}
+
+	template <class Action>
+	bool WithChildState(EnumState enumValue, Action&& action)
+	{
+		return WithChildState(enumValue, action, std::index_sequence_for<ChildStates...>());
+	}
+
+	// A child state supports a triggerless transition by declaring
+	// EntryAction(EnumState& triggerless).  Otherwise the plain
+	// EntryAction() runs and no state change follows.
+	template <class ChildState>
+	static auto EntryAction(ChildState& stateInstance, EnumState& triggerless, int) -> decltype(stateInstance.EntryAction(triggerless))
+	{
+		stateInstance.EntryAction(triggerless);
+	}
+
+	template <class ChildState>
+	static void EntryAction(ChildState& stateInstance, EnumState& triggerless, long)
+	{
+		stateInstance.EntryAction();
+		triggerless = EnumState::NOSTATECHANGE;
+	}
+
+	void ChangeState(EnumState newState)
+	{
+		if (newState == EnumState::NOSTATECHANGE)
+		{
+			return;
+		}
+
+		if (_currentState != EnumState::NOSTATE)
+		{
+			WithChildState(_currentState, [](auto& stateInstance)
+			{
+				stateInstance.ExitAction();
+				stateInstance.TransitionActions();
+			});
+		}
+
+		if (newState == EnumState::NOSTATE)
+		{
+			_currentState = EnumState::NOSTATE;
+		}
+		else
+		{
+			_currentState = newState;
+
+			EnumState triggerless = EnumState::NOSTATECHANGE;
+			WithChildState(_currentState, [&triggerless](auto& stateInstance)
+			{
+				EntryAction(stateInstance, triggerless, 0);
+			});
+
+			ChangeState(triggerless);
+		}
+	}
+
+public:
+	template <typename... Args>
+	StaticOrState(Args&... args) :
+		_childStates(ChildStates(args...)...)
+	{
+	}
+
+	void EntryAction()
+	{
+		Trigger(EnumTrigger::DEFAULTENTRY);
+	}
+
+	void ExitAction()
+	{
+		Trigger(EnumTrigger::DEFAULTEXIT);
+	}
+
+	EnumState GetCurrentState() { return _currentState; }
+
+	template <class ChildState>
+	ChildState& GetChildState() { return std::get<ChildState>(_childStates); }
+
+	EnumState Trigger(EnumTrigger trigger)
+	{
+		switch (trigger)
+		{
+		case EnumTrigger::DEFAULTENTRY:
+		{
+			if (_currentState != EnumState::NOSTATE)
+			{
+				return EnumState::NOSTATECHANGE;
+			}
+			ChangeState(defaultEntryState);
+		}
+		break;
+		case EnumTrigger::DEFAULTEXIT:
+		{
+			ChangeState(EnumState::NOSTATE);
+		}
+		break;
+		default:
+		{
+			if (_currentState != EnumState::NOSTATE)
+			{
+				EnumState targetState = EnumState::NOSTATECHANGE;
+				WithChildState(_currentState, [trigger, &targetState](auto& stateInstance)
+				{
+					targetState = stateInstance.Trigger(trigger);
+				});
+
+				ChangeState(targetState);
+			}
+		}
+		break;
+		}
+
+		return StaticStateTemplate<T, EnumTrigger, numTriggers, EnumState, id>::Trigger(trigger);
+	}
+};
@@ -0,0 +1,365 @@
+/*
+ * TimerWheel.h:
+ *	Hierarchical timing wheel delivering timeouts as triggers.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "StateMachine.h"
+
+// Identifies an armed timeout.  A handle goes stale once its timeout
+// has fired or been cancelled, and cancelling a stale handle does
+// nothing.
+struct TimerHandle
+{
+	uint32_t Index = 0;
+	uint32_t Generation = 0;
+};
+
+// TimerWheel keeps timeouts for any number of machines and delivers
+// each expiration as an ordinary trigger through the Trigger() of
+// the machine that armed it.  Time is counted in ticks whose length
+// is up to the caller: the wheel only moves when Advance() or
+// AdvanceTo() is called, so a test drives it as a virtual clock and
+// a real time loop calls AdvanceTo() with, for example, the current
+// steady_clock milliseconds.
+//
+// The wheel has four levels of 256 slots.  A timeout is linked into
+// the slot of the coarsest level its distance needs and moves down a
+// level each time the level below wraps, so arming, cancelling and
+// expiring a timeout are all constant time.  Timeouts live in one
+// node vector recycled through a free list, so a steady state of
+// millions of pending timeouts does not allocate.
+//
+// The wheel is not thread safe; advance it on the thread that
+// triggers its machines, such as the consumer of an ActiveObject.
+template <typename EnumState, typename EnumTrigger>
+class TimerWheel
+{
+public:
+	typedef State<EnumState, EnumTrigger> Machine;
+
+private:
+	static constexpr int SlotBits = 8;
+	static constexpr int SlotCount = 1 << SlotBits;
+	static constexpr int LevelCount = 4;
+	static constexpr uint64_t MaxDelta = ((uint64_t)1 << (SlotBits * LevelCount)) - 1;
+
+	// Nodes [0, SlotCount * LevelCount) are the list heads of the
+	// slots, the next one heads the timeouts expiring in the current
+	// tick and the rest hold timeouts.
+	static constexpr uint32_t ExpiringHead = SlotCount * LevelCount;
+	static constexpr uint32_t FirstTimer = ExpiringHead + 1;
+	static constexpr uint32_t NoNode = 0xFFFFFFFF;
+
+	struct Node
+	{
+		uint64_t Deadline;
+		uint32_t Prev;
+		uint32_t Next;
+		uint32_t Generation;
+		EnumTrigger Trigger;
+		Machine* Target;
+	};
+
+	std::vector<Node> _nodes;
+	uint32_t _free = NoNode;
+	uint64_t _time = 0;
+	size_t _pendingCount = 0;
+
+	void Unlink(uint32_t index)
+	{
+		Node& node = _nodes[index];
+		_nodes[node.Prev].Next = node.Next;
+		_nodes[node.Next].Prev = node.Prev;
+	}
+
+	void LinkBefore(uint32_t head, uint32_t index)
+	{
+		Node& node = _nodes[index];
+		node.Prev = _nodes[head].Prev;
+		node.Next = head;
+		_nodes[node.Prev].Next = index;
+		_nodes[head].Prev = index;
+	}
+
+	bool IsEmpty(uint32_t head) const
+	{
+		return _nodes[head].Next == head;
+	}
+
+	void Schedule(uint32_t index)
+	{
+		uint64_t deadline = _nodes[index].Deadline;
+		uint64_t delta = deadline - _time;
+
+		if (delta > MaxDelta)
+		{
+			// Parked in the top level and rescheduled from there.
+			deadline = _time + MaxDelta;
+			delta = MaxDelta;
+		}
+
+		int level = 0;
+		while (delta >= ((uint64_t)1 << (SlotBits * (level + 1))))
+		{
+			level++;
+		}
+
+		uint32_t slot = (uint32_t)(deadline >> (SlotBits * level)) & (SlotCount - 1);
+		LinkBefore(level * SlotCount + slot, index);
+	}
+
+	void Release(uint32_t index)
+	{
+		Node& node = _nodes[index];
+		node.Generation++;
+		node.Target = nullptr;
+		node.Next = _free;
+		_free = index;
+		_pendingCount--;
+	}
+
+	void Cascade(int level)
+	{
+		uint32_t head = level * SlotCount + ((uint32_t)(_time >> (SlotBits * level)) & (SlotCount - 1));
+
+		while (!IsEmpty(head))
+		{
+			uint32_t index = _nodes[head].Next;
+			Unlink(index);
+			Schedule(index);
+		}
+	}
+
+	size_t Tick()
+	{
+		_time++;
+
+		// Moves the timeouts of a coarser slot down once every level
+		// below it has wrapped.
+		int levels = 1;
+		while (levels < LevelCount && ((_time >> (SlotBits * levels)) << (SlotBits * levels)) == _time)
+		{
+			levels++;
+		}
+		for (int level = levels - 1; level > 0; level--)
+		{
+			Cascade(level);
+		}
+
+		uint32_t head = (uint32_t)_time & (SlotCount - 1);
+		if (IsEmpty(head))
+		{
+			return 0;
+		}
+
+		// Triggers may arm and cancel timeouts, including the ones
+		// still waiting here, so the slot is moved to its own list
+		// and taken one timeout at a time.
+		Node& slot = _nodes[head];
+		Node& expiring = _nodes[ExpiringHead];
+		expiring.Next = slot.Next;
+		expiring.Prev = slot.Prev;
+		_nodes[slot.Next].Prev = ExpiringHead;
+		_nodes[slot.Prev].Next = ExpiringHead;
+		slot.Next = slot.Prev = head;
+
+		size_t fired = 0;
+		while (!IsEmpty(ExpiringHead))
+		{
+			uint32_t index = _nodes[ExpiringHead].Next;
+			Unlink(index);
+
+			Machine* target = _nodes[index].Target;
+			EnumTrigger trigger = _nodes[index].Trigger;
+			Release(index);
+
+			target->Trigger(trigger);
+			fired++;
+		}
+		return fired;
+	}
+
+public:
+	// Reserves room for capacity pending timeouts up front.
+	TimerWheel(size_t capacity = 0)
+	{
+		_nodes.reserve(FirstTimer + capacity);
+		_nodes.resize(FirstTimer);
+		for (uint32_t i = 0; i < FirstTimer; i++)
+		{
+			_nodes[i].Prev = _nodes[i].Next = i;
+		}
+	}
+
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator=(const TimerWheel&) = delete;
+
+	uint64_t GetTime() const { return _time; }
+	size_t GetPendingCount() const { return _pendingCount; }
+
+	// Fires trigger on target once delay ticks have passed.  A
+	// timeout always waits at least one tick.
+	TimerHandle Arm(Machine* target, EnumTrigger trigger, uint64_t delay)
+	{
+		uint32_t index = _free;
+		if (index != NoNode)
+		{
+			_free = _nodes[index].Next;
+		}
+		else
+		{
+			assert(_nodes.size() < NoNode && "TimerWheel is full");
+			index = (uint32_t)_nodes.size();
+			_nodes.push_back(Node());
+			_nodes[index].Generation = 1;
+		}
+
+		Node& node = _nodes[index];
+		node.Deadline = _time + (delay == 0 ? 1 : delay);
+		node.Trigger = trigger;
+		node.Target = target;
+		Schedule(index);
+		_pendingCount++;
+
+		return TimerHandle{ index, node.Generation };
+	}
+
+	bool IsArmed(TimerHandle handle) const
+	{
+		return handle.Index >= FirstTimer &&
+			handle.Index < _nodes.size() &&
+			_nodes[handle.Index].Generation == handle.Generation &&
+			_nodes[handle.Index].Target != nullptr;
+	}
+
+	// Returns false when the timeout already fired or was cancelled.
+	bool Cancel(TimerHandle handle)
+	{
+		if (!IsArmed(handle))
+		{
+			return false;
+		}
+
+		Unlink(handle.Index);
+		Release(handle.Index);
+		return true;
+	}
+
+	// Moves the clock forward and fires every timeout that expires
+	// on the way, in deadline order.  Returns the number fired.
+	size_t Advance(uint64_t ticks)
+	{
+		size_t fired = 0;
+
+		while (ticks > 0 && _pendingCount > 0)
+		{
+			fired += Tick();
+			ticks--;
+		}
+		_time += ticks;
+		return fired;
+	}
+
+	size_t AdvanceTo(uint64_t time)
+	{
+		return time > _time ? Advance(time - _time) : 0;
+	}
+};
+
+// Adds timeouts to a state that are cancelled when the state exits.
+// Base is the StateTemplate or OrState the state would otherwise
+// derive from:
+//
+// class YourState : public TimedState<StateTemplate<YourState, TRIGGERS, (int)TRIGGERS::Count, STATES>>
+//
+// The state is given the wheel and the top-level machine that
+// receives the expirations, and arms its timeouts in EntryAction():
+//
+// void YourState::EntryAction()
+// {
+//	ArmTimeout(TRIGGERS::TIMEOUT, 500);
+// }
+//
+// A state that overrides ExitAction() calls TimedState::ExitAction()
+// from it, as a composite calls OrState::ExitAction().
+template <class Base, int numTimeouts = 1>
+class TimedState : public Base
+{
+public:
+	typedef typename Base::StateType EnumState;
+	typedef typename Base::TriggerType EnumTrigger;
+	typedef TimerWheel<EnumState, EnumTrigger> Wheel;
+
+private:
+	Wheel* _timerWheel = nullptr;
+	typename Wheel::Machine* _timerTarget = nullptr;
+	TimerHandle _timeouts[numTimeouts];
+	int _timeoutCount = 0;
+
+protected:
+	void ArmTimeout(EnumTrigger trigger, uint64_t delay)
+	{
+		assert(_timerWheel != nullptr && "TimedState has no timer wheel");
+
+		// Slots of timeouts that already fired are reused.
+		int slot = 0;
+		while (slot < _timeoutCount && _timerWheel->IsArmed(_timeouts[slot]))
+		{
+			slot++;
+		}
+		assert(slot < numTimeouts && "TimedState is full; raise numTimeouts");
+
+		_timeouts[slot] = _timerWheel->Arm(_timerTarget, trigger, delay);
+		if (slot == _timeoutCount)
+		{
+			_timeoutCount++;
+		}
+	}
+
+	void CancelTimeouts()
+	{
+		for (int i = 0; i < _timeoutCount; i++)
+		{
+			_timerWheel->Cancel(_timeouts[i]);
+		}
+		_timeoutCount = 0;
+	}
+
+public:
+	using Base::Base;
+
+	void SetTimerWheel(Wheel* wheel, typename Wheel::Machine* target)
+	{
+		_timerWheel = wheel;
+		_timerTarget = target;
+	}
+
+	void ExitAction() override
+	{
+		CancelTimeouts();
+		Base::ExitAction();
+	}
+};
@@ -0,0 +1,258 @@
+/*
+ * TracePolicy.h:
+ *	Transition tracing for a C++ UML state machine.
+ *	Copyright (c) 2019 Alger Pike
+ ***********************************************************************
+ * This file is part of CPlusPLusSateMachine:
+ *	https://github.com/AlgerP572/CPlusPlusStateMchine
+ *
+ *    CPlusPLusSateMachine is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    CPlusPLusSateMachine is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "StateMachine.h"
+
+// A trace policy is the last template argument of OrState.  The
+// composite calls the static hooks of the policy for its children:
+//
+// TriggerReceived(machine, state, trigger)  before the active child sees a trigger
+// GuardEvaluated(machine, state, trigger, target)  with the target the child returned
+// Exit(machine, state)  before a child's exit action
+// ExitCompleted(machine, state)  after it
+// TransitionAction(machine, state)  before the transition actions of a child
+// TransitionActionCompleted(machine, state)  after them
+// Entry(machine, state)  before a child's entry action
+// EntryCompleted(machine, state)  after it
+// TriggerlessHop(machine, state, target)  when an entered child moves on without a trigger
+// TriggerlessCompleted(machine, state, hops)  when a chain of triggerless hops rests in state
+// TriggerlessStopped(machine, state, target, hops)  when the hop limit or a cycle stops a chain
+//
+// machine is the composite.  A composite with an active child calls
+// TriggerReceived and GuardEvaluated for every trigger it receives.
+// When nothing below the child handles the trigger the child is not
+// called, target is NOSTATECHANGE, and composites inside the child
+// report nothing.
+//
+// NullTracePolicy, the default, has empty hooks.  RingTracePolicy
+// below records the hooks that start an activity;
+// HistogramTracePolicy.h uses the completions to measure durations.
+// RingTracePolicy stores a time stamped TraceRecord for each of
+// those in a ring buffer owned by the calling thread, so recording
+// needs no locks or atomic read-modify-write operations.  Recording
+// is switched on and off at run time.  While it is off each hook
+// costs one relaxed load and a predictable branch.
+
+enum class TraceEvent : uint8_t
+{
+	TriggerReceived,
+	GuardEvaluated,
+	Exit,
+	TransitionAction,
+	Entry,
+	TriggerlessHop,
+	TriggerlessCompleted,
+	TriggerlessStopped
+};
+
+// Trigger and Target are RESERVED_NO_STATE_CHANGE in records of
+// hooks that have no trigger or target, since 0 is a real value.
+struct TraceRecord
+{
+	uint64_t Timestamp;
+	const void* Machine;
+	TraceEvent Event;
+	short State;
+	short Trigger;
+	short Target;
+};
+
+// Time stamp counter on x86 and the virtual counter on ARM64.  Other
+// targets, such as the 32 bit Raspberry Pi build, use the steady
+// clock in nanoseconds.
+inline uint64_t TraceTimestamp()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t counter;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(counter));
+	return counter;
+#else
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Fixed size ring that keeps the most recent records.  Only the
+// owning thread writes.  Other threads may read it once the owner
+// has stopped writing.
+template <int capacity>
+class TraceRing
+{
+	static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "TraceRing capacity must be a power of two");
+
+private:
+	TraceRecord _records[capacity];
+	std::atomic<size_t> _written;
+
+public:
+	TraceRing() :
+		_written(0)
+	{
+	}
+
+	void Write(const TraceRecord& record)
+	{
+		size_t written = _written.load(std::memory_order_relaxed);
+
+		_records[written & (capacity - 1)] = record;
+		_written.store(written + 1, std::memory_order_release);
+	}
+
+	// Number of records written since the last Clear(), including
+	// those that have been overwritten.
+	size_t GetWritten() const { return _written.load(std::memory_order_acquire); }
+
+	size_t GetCount() const
+	{
+		size_t written = GetWritten();
+		return written < (size_t)capacity ? written : (size_t)capacity;
+	}
+
+	// Oldest record still held is index 0.
+	const TraceRecord& Get(size_t index) const
+	{
+		return _records[(GetWritten() - GetCount() + index) & (capacity - 1)];
+	}
+
+	void Clear() { _written.store(0, std::memory_order_release); }
+};
+
+template <int capacity = 4096>
+class RingTracePolicy
+{
+private:
+	static inline std::atomic<bool> _enabled{ false };
+
+	static void Record(TraceEvent event, const void* machine, short state, short trigger, short target)
+	{
+		GetRing().Write({ TraceTimestamp(), machine, event, state, trigger, target });
+	}
+
+public:
+	static void Enable(bool enable) { _enabled.store(enable, std::memory_order_relaxed); }
+	static bool IsEnabled() { return _enabled.load(std::memory_order_relaxed); }
+
+	// Ring of the calling thread.
+	static TraceRing<capacity>& GetRing()
+	{
+		static thread_local TraceRing<capacity> ring;
+		return ring;
+	}
+
+	template <typename EnumState, typename EnumTrigger>
+	static void TriggerReceived(const void* machine, EnumState state, EnumTrigger trigger)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::TriggerReceived, machine, (short)state, (short)trigger, RESERVED_NO_STATE_CHANGE);
+		}
+	}
+
+	template <typename EnumState, typename EnumTrigger>
+	static void GuardEvaluated(const void* machine, EnumState state, EnumTrigger trigger, EnumState target)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::GuardEvaluated, machine, (short)state, (short)trigger, (short)target);
+		}
+	}
+
+	template <typename EnumState>
+	static void Exit(const void* machine, EnumState state)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::Exit, machine, (short)state, RESERVED_NO_STATE_CHANGE, RESERVED_NO_STATE_CHANGE);
+		}
+	}
+
+	template <typename EnumState>
+	static void ExitCompleted(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void TransitionAction(const void* machine, EnumState state)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::TransitionAction, machine, (short)state, RESERVED_NO_STATE_CHANGE, RESERVED_NO_STATE_CHANGE);
+		}
+	}
+
+	template <typename EnumState>
+	static void TransitionActionCompleted(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void Entry(const void* machine, EnumState state)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::Entry, machine, (short)state, RESERVED_NO_STATE_CHANGE, RESERVED_NO_STATE_CHANGE);
+		}
+	}
+
+	template <typename EnumState>
+	static void EntryCompleted(const void*, EnumState) {}
+
+	template <typename EnumState>
+	static void TriggerlessHop(const void* machine, EnumState state, EnumState target)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::TriggerlessHop, machine, (short)state, RESERVED_NO_STATE_CHANGE, (short)target);
+		}
+	}
+
+	// The hop count is recorded in the trigger field.
+	template <typename EnumState>
+	static void TriggerlessCompleted(const void* machine, EnumState state, int hops)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::TriggerlessCompleted, machine, (short)state, (short)hops, RESERVED_NO_STATE_CHANGE);
+		}
+	}
+
+	template <typename EnumState>
+	static void TriggerlessStopped(const void* machine, EnumState state, EnumState target, int hops)
+	{
+		if (IsEnabled())
+		{
+			Record(TraceEvent::TriggerlessStopped, machine, (short)state, (short)hops, (short)target);
+		}
+	}
+};
@@ -20,16 +20,65 @@
  *    along with CPlusPLusSateMachine.  If not, see <http://www.gnu.org/licenses/>.
  ***********************************************************************
 */
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "./ActiveObject.h"
+#include "./MachineScheduler.h"
+#include "./RegionWorkerPool.h"
+#include "./Journal.h"
+#include "./FlatPopulation.h"
 #include "./SimpleStateMachine/SimpleStateMachine.h"
 #include "./KeyboardStateMachine/KeyBoardStateMachine.h"
+#include "./KeyboardStateMachine/Default.h"
+#include "./KeyboardStateMachine/CapsLocked.h"
+#include "./KeyboardStateMachine/KeyboardFlatStateMachine.h"
+#include "./KeyboardStateMachine/KeyboardTracedStateMachine.h"
+#include "./KeyboardStateMachine/KeyboardProfiledStateMachine.h"
+#include "./KeyboardStateMachine/KeyboardPairStateMachine.h"
+#include "./KeyboardStateMachine/KeyboardTimedStateMachine.h"
 #include "./KeyboardStateMachineExtended/KeyboardStateModel.h"
 #include "./KeyboardStateMachineExtended/KeyBoardStateMachineExtended.h"
+#include "./KeyboardStateMachineExtended/DefaultExtended.h"
+#include "./KeyboardStateMachineExtended/CapsLockedExtended.h"
+#include "./KeyboardStateMachineExtended/KeyboardFlatStateMachineExtended.h"
 #include "./SStateMachine/s.h"
+#include "./SStateMachine/S1.h"
+#include "./SStateMachine/S11.h"
+#include "./SStateMachine/S2.h"
+#include "./SStateMachine/S21.h"
+#include "./SStateMachine/SFlat.h"
+#include "./SStateMachine/SStatic.h"
 
 void TestSimpleStateMachine();
 void TestKeyboardStateMachine();
 void TestKeyboardStateMachineExtended();
 void TestSStateMachineExtended();
+void TestSFlatStateMachine();
+void TestSStaticStateMachine();
+void TestActiveObject();
+void TestMachineScheduler();
+void TestSStateMachineArena();
+void TestStateMemory();
+void TestKeyboardFlatStateMachineExtended();
+void TestKeyboardStateMachineExtendedBatch();
+void TestFlatPopulation();
+void TestTracePolicy();
+void TestHistogramTracePolicy();
+void TestKeyboardStateMachineExtendedEvents();
+void TestKeyboardPairStateMachine();
+void TestTimerWheel();
+void TestSnapshot();
+void TestJournal();
+void TestFlatDefinitionValidation();
+void TestFlatTransitionPaths();
+void TestHistory();
+void TestDeferredTriggers();
+void TestTriggerlessChain();
+void TestConstantTransitions();
+void TestHandledTriggers();
 
 int main(void)
 {	
@@ -37,6 +86,29 @@ int main(void)
 	TestKeyboardStateMachine();
 	TestKeyboardStateMachineExtended();
 	TestSStateMachineExtended();
+	TestSFlatStateMachine();
+	TestSStaticStateMachine();
+	TestActiveObject();
+	TestMachineScheduler();
+	TestSStateMachineArena();
+	TestStateMemory();
+	TestKeyboardFlatStateMachineExtended();
+	TestKeyboardStateMachineExtendedBatch();
+	TestFlatPopulation();
+	TestTracePolicy();
+	TestHistogramTracePolicy();
+	TestKeyboardStateMachineExtendedEvents();
+	TestKeyboardPairStateMachine();
+	TestTimerWheel();
+	TestSnapshot();
+	TestJournal();
+	TestFlatDefinitionValidation();
+	TestFlatTransitionPaths();
+	TestHistory();
+	TestDeferredTriggers();
+	TestTriggerlessChain();
+	TestConstantTransitions();
+	TestHandledTriggers();
 	return 0;
 }
 
@@ -115,6 +187,8 @@ void TestKeyboardStateMachineExtended()
 		stateModel.SetPressedKey('a');
 		sm.Trigger(KEYBOARDTRIGGERSExtended::ANYKEY);
 		stateNow = sm.GetCurrentState();
+		if (stateModel.GetPressedKey() != 'a')
+			throw "Pressed key not kept";
 		
 		sm.Trigger(KEYBOARDTRIGGERSExtended::CAPSLOCK);
 		stateNow = sm.GetCurrentState();		
@@ -145,4 +219,1482 @@ void TestSStateMachineExtended()
 	stateNow = stateMachine.GetCurrentState();
 	if (stateNow != SSTATES::S2)
 		throw "S state not correct";
+}
+
+void TestSFlatStateMachine()
+{
+	SFlat stateMachine;
+
+	SSTATES stateNow = stateMachine.GetCurrentState();
+
+	stateMachine.Trigger(STRIGGERS::DEFAULTENTRY);
+	stateNow = stateMachine.GetCurrentState();
+	if (stateNow != SSTATES::S11 || !stateMachine.IsInState(SSTATES::S1))
+		throw "S flat state not correct";
+
+	stateMachine.Trigger(STRIGGERS::T);
+	stateNow = stateMachine.GetCurrentState();
+	if (stateNow != SSTATES::S21 || !stateMachine.IsInState(SSTATES::S2))
+		throw "S flat state not correct";
+
+	stateMachine.Trigger(STRIGGERS::DEFAULTEXIT);
+	stateNow = stateMachine.GetCurrentState();
+	if (stateNow != SSTATES::NOSTATE)
+		throw "S flat state not correct";
+}
+
+void TestSStaticStateMachine()
+{
+	SStatic stateMachine;
+
+	SSTATES stateNow = stateMachine.GetCurrentState();
+
+	stateMachine.Trigger(STRIGGERS::DEFAULTENTRY);
+	stateNow = stateMachine.GetCurrentState();
+	if (stateNow != SSTATES::S1)
+		throw "S static state not correct";
+
+	stateNow = stateMachine.GetChildState<S1Static>().GetCurrentState();
+	if (stateNow != SSTATES::S11)
+		throw "S static state not correct";
+
+	stateMachine.Trigger(STRIGGERS::T);
+	stateNow = stateMachine.GetCurrentState();
+	if (stateNow != SSTATES::S2)
+		throw "S static state not correct";
+
+	stateNow = stateMachine.GetChildState<S2Static>().GetCurrentState();
+	if (stateNow != SSTATES::S21)
+		throw "S static state not correct";
+}
+
+void TestActiveObject()
+{
+	KeyboardStateMachine sm;
+	ActiveObject<KeyboardStateMachine, KEYBOARDTRIGGERS, 256> activeObject(sm);
+
+	activeObject.Post(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	activeObject.Start();
+
+	// Each producer toggles caps lock an even number of times.
+	const int producerCount = 4;
+	const int postCount = 10000;
+	std::vector<std::thread> producers;
+	for (int i = 0; i < producerCount; i++)
+	{
+		producers.emplace_back([&activeObject]()
+		{
+			for (int j = 0; j < postCount; j++)
+			{
+				KEYBOARDTRIGGERS trigger = (j % 3 == 0) ? KEYBOARDTRIGGERS::ANYKEY : KEYBOARDTRIGGERS::CAPSLOCK;
+				while (!activeObject.Post(trigger))
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+	activeObject.Stop();
+
+	if (activeObject.GetDispatchedCount() != producerCount * postCount + 1)
+		throw "Active object lost events";
+
+	if (sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Keyboard state not correct";
+}
+
+void TestMachineScheduler()
+{
+	const int machineCount = 1000;
+	const int postCount = 20;
+	std::vector<std::unique_ptr<KeyboardStateMachine>> machines;
+	MachineScheduler<KeyboardStateMachine, KEYBOARDTRIGGERS, 64> scheduler(4, machineCount);
+
+	for (int i = 0; i < machineCount; i++)
+	{
+		machines.emplace_back(new KeyboardStateMachine());
+		int id = scheduler.Add(*machines.back());
+		scheduler.Post(id, KEYBOARDTRIGGERS::DEFAULTENTRY);
+	}
+	scheduler.Start();
+
+	// Two producers toggle caps lock on every machine an even
+	// number of times.
+	std::vector<std::thread> producers;
+	for (int i = 0; i < 2; i++)
+	{
+		producers.emplace_back([&scheduler]()
+		{
+			for (int j = 0; j < postCount; j++)
+			{
+				for (int id = 0; id < machineCount; id++)
+				{
+					while (!scheduler.Post(id, KEYBOARDTRIGGERS::CAPSLOCK))
+					{
+						std::this_thread::yield();
+					}
+				}
+			}
+		});
+	}
+
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+
+	size_t expected = machineCount * (2 * postCount + 1);
+	while (scheduler.GetDispatchedCount() != expected)
+	{
+		std::this_thread::yield();
+	}
+	scheduler.Stop();
+
+	for (auto& machine : machines)
+	{
+		if (machine->GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+			throw "Keyboard state not correct";
+	}
+}
+
+void TestSStateMachineArena()
+{
+	// The whole S hierarchy in one block on the stack.
+	const size_t arenaSize = StateArena::SizeFor<S1, S11, S2, S21>();
+	alignas(std::max_align_t) char buffer[arenaSize];
+	StateArena arena(buffer, sizeof(buffer));
+
+	{
+		S stateMachine(&arena);
+
+		if (arena.GetUsed() < sizeof(S1) + sizeof(S11) + sizeof(S2) + sizeof(S21))
+			throw "S states not allocated from the arena";
+
+		stateMachine.Trigger(STRIGGERS::DEFAULTENTRY);
+		stateMachine.Trigger(STRIGGERS::T);
+		if (stateMachine.GetCurrentState() != SSTATES::S2)
+			throw "S state not correct";
+	}
+
+	arena.Reset();
+
+	// A buffer that is not aligned still gives aligned states.
+	alignas(std::max_align_t) char unaligned[arenaSize + 1];
+	StateArena offsetArena(unaligned + 1, arenaSize);
+	{
+		S stateMachine(&offsetArena);
+
+		void* first = offsetArena.Allocate(1, alignof(std::max_align_t));
+		if (first != nullptr && (uintptr_t)first % alignof(std::max_align_t) != 0)
+			throw "Arena allocation not aligned";
+
+		stateMachine.Trigger(STRIGGERS::DEFAULTENTRY);
+		stateMachine.Trigger(STRIGGERS::T);
+		if (stateMachine.GetCurrentState() != SSTATES::S2)
+			throw "S state not correct";
+	}
+	offsetArena.Reset();
+}
+
+enum class WIDESTATES
+{
+	NOSTATE = RESERVED_NO_STATE,
+	NOSTATECHANGE = RESERVED_NO_STATE_CHANGE,
+	FIRST = 0,
+	Count = 200
+};
+
+enum class WIDETRIGGERS
+{
+	DEFAULTENTRY = RESERVED_TRIGGER_DEFAULT_ENTRY,
+	DEFAULTEXIT = RESERVED_TRIGGER_DEFAULT_EXIT,
+	FIRST = 0,
+	Count = 100
+};
+
+class WideComposite;
+
+void TestStateMemory()
+{
+	// Per instance memory of the S hierarchy base classes with tables
+	// sized by the machine wide counts and by the actual counts.
+	size_t sDense = sizeof(OrState<S, STRIGGERS, (int)STRIGGERS::Count, SSTATES, (int)SSTATES::Count, SSTATES::S1>) +
+		sizeof(OrState<S1, STRIGGERS, (int)STRIGGERS::Count, SSTATES, (int)SSTATES::Count, SSTATES::S11>) +
+		sizeof(StateTemplate<S11, STRIGGERS, (int)STRIGGERS::Count, SSTATES>) +
+		sizeof(OrState<S2, STRIGGERS, (int)STRIGGERS::Count, SSTATES, (int)SSTATES::Count, SSTATES::S21>) +
+		sizeof(StateTemplate<S21, STRIGGERS, (int)STRIGGERS::Count, SSTATES>);
+	size_t sCompact = sizeof(OrState<S, STRIGGERS, (int)STRIGGERS::Count, SSTATES, (int)SSTATES::Count, SSTATES::S1, 2, 0>) +
+		sizeof(OrState<S1, STRIGGERS, (int)STRIGGERS::Count, SSTATES, (int)SSTATES::Count, SSTATES::S11, 1, 1>) +
+		sizeof(StateTemplate<S11, STRIGGERS, (int)STRIGGERS::Count, SSTATES, 0>) +
+		sizeof(OrState<S2, STRIGGERS, (int)STRIGGERS::Count, SSTATES, (int)SSTATES::Count, SSTATES::S21, 1, 0>) +
+		sizeof(StateTemplate<S21, STRIGGERS, (int)STRIGGERS::Count, SSTATES, 0>);
+
+	// A composite of a machine with 200 states and 100 triggers that
+	// has 4 children and 4 guards.
+	size_t wideDense = sizeof(OrState<WideComposite, WIDETRIGGERS, (int)WIDETRIGGERS::Count, WIDESTATES, (int)WIDESTATES::Count, WIDESTATES::FIRST>);
+	size_t wideCompact = sizeof(OrState<WideComposite, WIDETRIGGERS, (int)WIDETRIGGERS::Count, WIDESTATES, (int)WIDESTATES::Count, WIDESTATES::FIRST, 4, 4>);
+
+	printf("\nS machine: %zu bytes dense, %zu bytes compact\n", sDense, sCompact);
+	printf("Wide composite: %zu bytes dense, %zu bytes compact\n", wideDense, wideCompact);
+
+	if (sCompact >= sDense || wideCompact >= wideDense)
+		throw "Compact state tables not smaller";
+
+	// A full compact table rejects new keys and keeps its entries.
+	S11 s11;
+	S21 s21;
+	StateTable<SSTATES, State<SSTATES, STRIGGERS>*, (int)SSTATES::Count, 1> table;
+	if (!table.Set(SSTATES::S11, &s11) || table.Set(SSTATES::S21, &s21) ||
+		table.Find(SSTATES::S11) != &s11 || table.Find(SSTATES::S21) != nullptr ||
+		!table.CanSet(SSTATES::S11) || table.CanSet(SSTATES::S21))
+		throw "Full state table not rejected";
+}
+
+void TestKeyboardFlatStateMachineExtended()
+{
+	const int sessionCount = 100000;
+	const int keyCount = 10;
+
+	// Every session shares the flat tables and keeps only its active
+	// state and the pointer to its own model.
+	std::vector<KeyboardStateModel> stateModels(sessionCount);
+	std::vector<KeyboardFlatStateMachineExtended> sessions;
+	sessions.reserve(sessionCount);
+
+	for (int i = 0; i < sessionCount; i++)
+	{
+		stateModels[i].SetKeyCount(keyCount);
+		sessions.emplace_back(stateModels[i]);
+		sessions[i].Trigger(KEYBOARDTRIGGERSExtended::DEFAULTENTRY);
+	}
+
+	for (int i = 0; i < sessionCount; i++)
+	{
+		KeyboardFlatStateMachineExtended& sm = sessions[i];
+
+		if (sm.GetCurrentState() != KEYBOARDSTATESExtended::DEFAULT)
+			throw "Keyboard state not correct";
+
+		while (sm.GetCurrentState() != KEYBOARDSTATESExtended::NOSTATE)
+		{
+			sm.GetStateModel().SetPressedKey('a');
+			sm.Trigger(KEYBOARDTRIGGERSExtended::ANYKEY);
+			if (sm.GetStateModel().GetPressedKey() != 'a')
+				throw "Pressed key not kept";
+			sm.Trigger(KEYBOARDTRIGGERSExtended::CAPSLOCK);
+		}
+
+		if (stateModels[i].GetKeyCount() != 0)
+			throw stateModels[i].GetKeyCount();
+	}
+
+	printf("Keyboard session: %zu bytes flat, %zu bytes object graph\n",
+		sizeof(KeyboardFlatStateMachineExtended),
+		sizeof(KeyboardStateMachineExtended) + sizeof(DefaultExtended) + sizeof(CapsLockedExtended));
+}
+
+void TestKeyboardStateMachineExtendedBatch()
+{
+	const int keyCount = 1000;
+	const size_t batchSize = 4096;
+
+	KeyboardStateModel stateModel;
+	stateModel.SetKeyCount(keyCount);
+
+	KeyboardStateMachineExtended sm(stateModel);
+
+	std::vector<KEYBOARDTRIGGERSExtended> triggers(batchSize);
+	std::vector<char> keys(batchSize);
+
+	triggers[0] = KEYBOARDTRIGGERSExtended::DEFAULTENTRY;
+	for (size_t i = 1; i < batchSize; i++)
+	{
+		triggers[i] = (i % 2) == 1 ?
+			KEYBOARDTRIGGERSExtended::ANYKEY :
+			KEYBOARDTRIGGERSExtended::CAPSLOCK;
+		keys[i] = (char)('a' + i % 26);
+	}
+
+	TriggerBatchResult<KEYBOARDSTATESExtended> result = sm.TriggerBatch(triggers.data(), keys.data(), batchSize,
+		[&](char key) { stateModel.SetPressedKey(key); });
+
+	// Entry, 1000 key and caps lock pairs and the key that exits.
+	if (result.Consumed != 2 * keyCount + 2)
+		throw "Keyboard batch not consumed correctly";
+
+	if (result.CurrentState != KEYBOARDSTATESExtended::NOSTATE ||
+		sm.GetCurrentState() != KEYBOARDSTATESExtended::NOSTATE)
+		throw "Keyboard state not correct";
+
+	if (stateModel.GetKeyCount() != 0)
+		throw stateModel.GetKeyCount();
+
+	// The key delivered with the last trigger is kept.
+	if (stateModel.GetPressedKey() != keys[result.Consumed - 1])
+		throw "Pressed key not kept";
+
+	// A machine that was left consumes nothing more.
+	result = sm.TriggerBatch(triggers.data() + 1, batchSize - 1);
+	if (result.Consumed != 0)
+		throw "Keyboard batch not consumed correctly";
+}
+
+void TestFlatPopulation()
+{
+	const size_t keyboardCount = 1000000;
+	const int stepCount = 100;
+
+	FlatPopulation<KeyboardFlatStateMachine> keyboards(keyboardCount);
+
+	keyboards.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	if (keyboards.CountInState(KEYBOARDSTATES::DEFAULT) != keyboardCount)
+		throw "Keyboard population state not correct";
+
+	keyboards.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (keyboards.CountInState(KEYBOARDSTATES::CAPSLOCKED) != keyboardCount)
+		throw "Keyboard population state not correct";
+
+	// One trigger per keyboard, checked against a single machine.
+	std::vector<KEYBOARDTRIGGERS> triggers(keyboardCount);
+	for (size_t i = 0; i < keyboardCount; i++)
+	{
+		triggers[i] = (i % 3) == 0 ?
+			KEYBOARDTRIGGERS::CAPSLOCK :
+			KEYBOARDTRIGGERS::ANYKEY;
+	}
+
+	keyboards.Trigger(triggers.data());
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		KeyboardFlatStateMachine sm;
+		sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+		sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+		sm.Trigger(triggers[i]);
+
+		if (keyboards.GetState(i) != sm.GetCurrentState())
+			throw "Keyboard population state not correct";
+	}
+
+	if (keyboards.CountInState(KEYBOARDSTATES::DEFAULT) != (keyboardCount + 2) / 3)
+		throw "Keyboard population state not correct";
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < stepCount; i++)
+	{
+		keyboards.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	printf("Keyboard population: %.0f million steps per second\n",
+		keyboardCount * (double)stepCount / elapsed.count() / 1e6);
+
+	keyboards.Trigger(KEYBOARDTRIGGERS::DEFAULTEXIT);
+	if (keyboards.CountInState(KEYBOARDSTATES::NOSTATE) != keyboardCount)
+		throw "Keyboard population state not correct";
+}
+
+void TestTracePolicy()
+{
+	KeyboardTracedStateMachine sm;
+	TraceRing<4096>& ring = RingTracePolicy<>::GetRing();
+
+	ring.Clear();
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	if (ring.GetWritten() != 0)
+		throw "Trace recorded while disabled";
+
+	// TIMEOUT is not handled by the keyboard but is still traced.
+	RingTracePolicy<>::Enable(true);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	RingTracePolicy<>::Enable(false);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+
+	const TraceEvent expected[] =
+	{
+		TraceEvent::TriggerReceived,
+		TraceEvent::GuardEvaluated,
+		TraceEvent::Exit,
+		TraceEvent::TransitionAction,
+		TraceEvent::Entry,
+		TraceEvent::TriggerReceived,
+		TraceEvent::GuardEvaluated
+	};
+
+	if (ring.GetCount() != sizeof(expected) / sizeof(expected[0]))
+		throw "Trace record count not correct";
+
+	for (size_t i = 0; i < ring.GetCount(); i++)
+	{
+		const TraceRecord& record = ring.Get(i);
+
+		if (record.Event != expected[i] || record.Machine != &sm)
+			throw "Trace record not correct";
+	}
+
+	const TraceRecord& guard = ring.Get(1);
+	if (guard.State != (short)KEYBOARDSTATES::DEFAULT ||
+		guard.Trigger != (short)KEYBOARDTRIGGERS::CAPSLOCK ||
+		guard.Target != (short)KEYBOARDSTATES::CAPSLOCKED)
+		throw "Trace record not correct";
+
+	// Exit, transition action and entry have no trigger.
+	for (size_t i = 2; i < 5; i++)
+	{
+		if (ring.Get(i).Trigger != RESERVED_NO_STATE_CHANGE)
+			throw "Trace record not correct";
+	}
+
+	const TraceRecord& ignored = ring.Get(6);
+	if (ignored.State != (short)KEYBOARDSTATES::CAPSLOCKED ||
+		ignored.Trigger != (short)KEYBOARDTRIGGERS::TIMEOUT ||
+		ignored.Target != (short)KEYBOARDSTATES::NOSTATECHANGE)
+		throw "Ignored trigger not traced";
+}
+
+void TestHistogramTracePolicy()
+{
+	const int threadCount = 2;
+	const int keyCount = 1000;
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back([]()
+		{
+			KeyboardProfiledStateMachine sm;
+
+			sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+			for (int key = 0; key < keyCount; key++)
+			{
+				sm.Trigger(KEYBOARDTRIGGERS::ANYKEY);
+				sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<LatencyEntry> snapshot = KeyboardLatencyPolicy::Snapshot();
+
+	uint64_t guards = 0;
+	uint64_t exits = 0;
+	uint64_t entries = 0;
+
+	for (const LatencyEntry& entry : snapshot)
+	{
+		if (entry.State != (short)KEYBOARDSTATES::DEFAULT)
+			throw "Latency entry not correct";
+
+		if (entry.Histogram.GetValueAtPercentile(50.0) > entry.Histogram.GetMax())
+			throw "Latency percentile not correct";
+
+		switch (entry.Kind)
+		{
+		case LatencyKind::Guard: guards += entry.Histogram.GetCount(); break;
+		case LatencyKind::Exit: exits += entry.Histogram.GetCount(); break;
+		case LatencyKind::Entry: entries += entry.Histogram.GetCount(); break;
+		default: break;
+		}
+	}
+
+	// Every key is a self transition, the first entry is the
+	// default entry.  The ignored TIMEOUTs only add guards.
+	if (guards != 2 * threadCount * keyCount ||
+		exits != threadCount * keyCount ||
+		entries != threadCount * (keyCount + 1))
+		throw "Latency count not correct";
+}
+
+void TestKeyboardStateMachineExtendedEvents()
+{
+	typedef TriggerEvent<KEYBOARDTRIGGERSExtended> KeyboardEvent;
+
+	KeyboardStateModel stateModel;
+	stateModel.SetKeyCount(100);
+	stateModel.SetPressedKey(0);
+
+	KeyboardStateMachineExtended sm(stateModel);
+
+	// Events carry the key, so nothing is written to the model
+	// before a trigger and events can be queued.
+	ActiveObject<KeyboardStateMachineExtended, KeyboardEvent, 64> activeObject(sm);
+
+	activeObject.Post({ KEYBOARDTRIGGERSExtended::DEFAULTENTRY });
+	activeObject.Post({ KEYBOARDTRIGGERSExtended::ANYKEY, { 'x' } });
+	activeObject.Post({ KEYBOARDTRIGGERSExtended::CAPSLOCK });
+	activeObject.Post({ KEYBOARDTRIGGERSExtended::ANYKEY, { 'y' } });
+	activeObject.Dispatch();
+
+	if (sm.GetCurrentState() != KEYBOARDSTATESExtended::CAPSLOCKED ||
+		stateModel.GetPressedKey() != 'y' ||
+		stateModel.GetKeyCount() != 98)
+		throw "Keyboard event not delivered";
+
+	std::vector<KeyboardEvent> events;
+	for (int i = 0; i < 98; i++)
+	{
+		events.push_back({ KEYBOARDTRIGGERSExtended::ANYKEY, { (char)('a' + i % 26) } });
+	}
+
+	TriggerBatchResult<KEYBOARDSTATESExtended> result = sm.TriggerBatch(events.data(), events.size());
+
+	if (result.Consumed != events.size() ||
+		stateModel.GetPressedKey() != events.back().Data.Key ||
+		stateModel.GetKeyCount() != 0)
+		throw "Keyboard event not delivered";
+
+	// Out of keys, the next key exits.
+	sm.Trigger(KeyboardEvent{ KEYBOARDTRIGGERSExtended::ANYKEY, { 'z' } });
+	if (sm.GetCurrentState() != KEYBOARDSTATESExtended::NOSTATE)
+		throw "Keyboard state not correct";
+}
+
+void TestKeyboardPairStateMachine()
+{
+	KeyboardPairStateMachine sm;
+
+	KeyboardStateMachine* local = sm.GetRegion<KeyboardStateMachine>(0);
+	KeyboardStateMachine* remote = sm.GetRegion<KeyboardStateMachine>(1);
+
+	// Regions are not active before the and state is entered.
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (local->GetCurrentState() != KEYBOARDSTATES::NOSTATE ||
+		remote->GetCurrentState() != KEYBOARDSTATES::NOSTATE)
+		throw "Keyboard pair state not correct";
+
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	if (!sm.IsActive() ||
+		local->GetCurrentState() != KEYBOARDSTATES::DEFAULT ||
+		remote->GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Keyboard pair state not correct";
+
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (local->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED ||
+		remote->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Keyboard pair state not correct";
+
+	// Same broadcast with the regions dispatched on the pool.
+	RegionWorkerPool pool(2);
+	sm.SetDispatcher(&pool);
+
+	for (int i = 0; i < 1001; i++)
+	{
+		sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+		sm.Trigger(KEYBOARDTRIGGERS::ANYKEY);
+	}
+
+	if (local->GetCurrentState() != KEYBOARDSTATES::DEFAULT ||
+		remote->GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Keyboard pair state not correct";
+
+	// With a deferred queue attached the regions are dispatched in
+	// order even though a dispatcher is set.
+	DeferredTriggerQueue<KEYBOARDTRIGGERS> deferred(4);
+	sm.SetDeferredQueue(&deferred);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (local->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED ||
+		remote->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Keyboard pair state not correct";
+
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.SetDeferredQueue(nullptr);
+
+	sm.SetDispatcher(nullptr);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTEXIT);
+	if (sm.IsActive() ||
+		local->GetCurrentState() != KEYBOARDSTATES::NOSTATE ||
+		remote->GetCurrentState() != KEYBOARDSTATES::NOSTATE)
+		throw "Keyboard pair state not correct";
+}
+
+void TestTimerWheel()
+{
+	// The wheel is the virtual clock of the machine.
+	KeyboardTimerWheel wheel;
+	KeyboardTimedStateMachine sm(wheel, 500);
+
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED || wheel.GetPendingCount() != 1)
+		throw "Timeout not armed";
+
+	// A key press restarts the timeout.
+	wheel.Advance(499);
+	sm.Trigger(KEYBOARDTRIGGERS::ANYKEY);
+	wheel.Advance(499);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED || wheel.GetPendingCount() != 1)
+		throw "Timeout not restarted";
+
+	if (wheel.Advance(1) != 1 ||
+		sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT ||
+		wheel.GetPendingCount() != 0)
+		throw "Timeout not delivered";
+
+	// Leaving the state cancels its timeout.
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT ||
+		wheel.GetPendingCount() != 0 ||
+		wheel.Advance(1000) != 0)
+		throw "Timeout not cancelled";
+
+	// Many timeouts on every level of the wheel, with a third of
+	// them cancelled, fire in their own tick.
+	const int timeoutCount = 1000000;
+	const uint64_t window = 1024;
+	const uint64_t horizon = (uint64_t)1 << 26;
+
+	KeyboardStateMachine target;
+	target.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+
+	KeyboardTimerWheel largeWheel(timeoutCount);
+	std::vector<uint32_t> expected((size_t)(horizon / window) + 1);
+	std::vector<TimerHandle> handles(timeoutCount);
+
+	uint32_t random = 12345;
+	for (int i = 0; i < timeoutCount; i++)
+	{
+		random = random * 1664525 + 1013904223;
+		uint64_t delay = 1 + (random >> 6) % (horizon - 1);
+
+		handles[i] = largeWheel.Arm(&target, KEYBOARDTRIGGERS::ANYKEY, delay);
+		if (i % 3 == 0)
+		{
+			largeWheel.Cancel(handles[i]);
+		}
+		else
+		{
+			expected[(size_t)((delay - 1) / window)]++;
+		}
+	}
+
+	if (largeWheel.GetPendingCount() != timeoutCount - (timeoutCount + 2) / 3 ||
+		largeWheel.Cancel(handles[0]))
+		throw "Timeout count not correct";
+
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		if (largeWheel.Advance(window) != expected[i])
+			throw "Timeout not delivered in its tick";
+	}
+
+	if (largeWheel.GetPendingCount() != 0 || largeWheel.IsArmed(handles[1]))
+		throw "Timeout count not correct";
+}
+
+void TestSnapshot()
+{
+	// Every composite level of S -> S2 -> S21 is restored.
+	S s;
+	s.Trigger(STRIGGERS::DEFAULTENTRY);
+	s.Trigger(STRIGGERS::T);
+
+	std::vector<unsigned char> buffer;
+	SnapshotWriter writer(buffer);
+	s.Save(writer);
+
+	S restoredS;
+	SnapshotReader reader(buffer);
+	restoredS.Restore(reader);
+
+	std::vector<unsigned char> restoredBuffer;
+	SnapshotWriter restoredWriter(restoredBuffer);
+	restoredS.Save(restoredWriter);
+
+	if (!reader.IsValid() || reader.GetRemaining() != 0 ||
+		restoredS.GetCurrentState() != SSTATES::S2 ||
+		restoredBuffer != buffer)
+		throw "S snapshot not restored";
+
+	// Restoring runs no entry actions.
+	KeyboardTracedStateMachine traced;
+	traced.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	traced.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+
+	buffer.clear();
+	traced.Save(writer);
+
+	KeyboardTracedStateMachine restoredTraced;
+	TraceRing<4096>& ring = RingTracePolicy<>::GetRing();
+	RingTracePolicy<>::Enable(true);
+	ring.Clear();
+
+	SnapshotReader tracedReader(buffer);
+	restoredTraced.Restore(tracedReader);
+	RingTracePolicy<>::Enable(false);
+
+	if (restoredTraced.GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED || ring.GetCount() != 0)
+		throw "Keyboard snapshot not restored";
+
+	// A truncated snapshot leaves the machine inactive.
+	S truncated;
+	SnapshotReader truncatedReader(buffer.data(), 0);
+	truncated.Restore(truncatedReader);
+	if (truncatedReader.IsValid() || truncated.GetCurrentState() != SSTATES::NOSTATE)
+		throw "Truncated snapshot accepted";
+
+	// A snapshot that fails in a nested composite also leaves the
+	// composites restored before it inactive.
+	std::vector<unsigned char> sBuffer;
+	SnapshotWriter sWriter(sBuffer);
+	s.Save(sWriter);
+
+	S partial;
+	partial.Trigger(STRIGGERS::DEFAULTENTRY);
+	SnapshotReader partialReader(sBuffer.data(), sBuffer.size() - 1);
+	partial.Restore(partialReader);
+
+	S inactive;
+	std::vector<unsigned char> partialBuffer;
+	std::vector<unsigned char> inactiveBuffer;
+	SnapshotWriter partialWriter(partialBuffer);
+	SnapshotWriter inactiveWriter(inactiveBuffer);
+	partial.Save(partialWriter);
+	inactive.Save(inactiveWriter);
+	if (partialReader.IsValid() || partialBuffer != inactiveBuffer)
+		throw "Partly restored snapshot left active";
+
+	// A flat machine only rests in a leaf state.
+	std::vector<unsigned char> flatBuffer;
+	SnapshotWriter flatWriter(flatBuffer);
+	WriteState(flatWriter, SSTATES::S2);
+
+	SFlat flat;
+	SnapshotReader flatReader(flatBuffer);
+	flat.Restore(flatReader);
+	if (flatReader.IsValid() || flat.GetCurrentState() != SSTATES::NOSTATE)
+		throw "Composite restored as the active flat state";
+
+	// Many sessions with their models go into one buffer.
+	const int sessionCount = 1000000;
+
+	std::vector<KeyboardStateModel> stateModels(sessionCount);
+	std::vector<KeyboardFlatStateMachineExtended> sessions;
+	sessions.reserve(sessionCount);
+
+	for (int i = 0; i < sessionCount; i++)
+	{
+		stateModels[i].SetKeyCount(i % 200);
+		stateModels[i].SetPressedKey('a');
+		sessions.emplace_back(stateModels[i]);
+		sessions[i].Trigger(KEYBOARDTRIGGERSExtended::DEFAULTENTRY);
+		if (i % 2 == 1)
+		{
+			sessions[i].Trigger(KEYBOARDTRIGGERSExtended::CAPSLOCK);
+		}
+	}
+
+	buffer.clear();
+	writer.Reserve(sessionCount * 4);
+	SaveSnapshots(sessions.data(), sessions.size(), writer);
+
+	std::vector<KeyboardStateModel> restoredModels(sessionCount);
+	std::vector<KeyboardFlatStateMachineExtended> restoredSessions;
+	restoredSessions.reserve(sessionCount);
+	for (int i = 0; i < sessionCount; i++)
+	{
+		restoredSessions.emplace_back(restoredModels[i]);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	SnapshotReader sessionReader(buffer);
+	bool restored = RestoreSnapshots(restoredSessions.data(), restoredSessions.size(), sessionReader);
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+	if (!restored || sessionReader.GetRemaining() != 0)
+		throw "Session snapshots not restored";
+
+	for (int i = 0; i < sessionCount; i++)
+	{
+		if (restoredSessions[i].GetCurrentState() != sessions[i].GetCurrentState() ||
+			restoredModels[i].GetKeyCount() != stateModels[i].GetKeyCount() ||
+			restoredModels[i].GetPressedKey() != 'a')
+			throw "Session snapshot not restored";
+	}
+
+	printf("Session snapshots: %zu bytes for %d sessions, restored in %lld us\n",
+		buffer.size(), sessionCount, (long long)elapsed.count());
+}
+
+void TestJournal()
+{
+	const char* path = "TestJournal.journal";
+	remove(path);
+
+	// Replaying from the start rebuilds S -> S2 -> S21 without the
+	// output of its actions.
+	{
+		Journal<STRIGGERS> journal;
+		if (!journal.Open(path))
+			throw "Journal not opened";
+
+		S s;
+		journal.Trigger(s, STRIGGERS::DEFAULTENTRY);
+		journal.Trigger(s, STRIGGERS::T);
+
+		S replayed;
+		if (journal.Replay(replayed) != 2 ||
+			replayed.GetCurrentState() != SSTATES::S2 ||
+			replayed.IsReplayMode())
+			throw "S journal not replayed";
+		journal.Clear();
+	}
+
+	// Payloads are journaled, and replay after reopening starts from
+	// the latest checkpoint.
+	typedef TriggerEvent<KEYBOARDTRIGGERSExtended> KeyboardEvent;
+
+	KeyboardStateModel stateModel;
+	stateModel.SetKeyCount(100);
+	stateModel.SetPressedKey(0);
+	{
+		Journal<KEYBOARDTRIGGERSExtended> journal;
+		if (!journal.Open(path, 64))
+			throw "Journal not opened";
+
+		KeyboardStateMachineExtended sm(stateModel);
+		journal.Trigger(sm, KeyboardEvent{ KEYBOARDTRIGGERSExtended::DEFAULTENTRY });
+		for (int i = 0; i < 40; i++)
+		{
+			journal.Trigger(sm, KeyboardEvent{ KEYBOARDTRIGGERSExtended::ANYKEY, { (char)('a' + i % 26) } });
+		}
+		journal.Checkpoint(sm);
+		journal.Trigger(sm, KeyboardEvent{ KEYBOARDTRIGGERSExtended::CAPSLOCK });
+		journal.Trigger(sm, KeyboardEvent{ KEYBOARDTRIGGERSExtended::ANYKEY, { 'q' } });
+		journal.Flush();
+	}
+	{
+		Journal<KEYBOARDTRIGGERSExtended> journal;
+		if (!journal.Open(path))
+			throw "Journal not opened";
+
+		KeyboardStateModel replayedModel;
+		KeyboardStateMachineExtended replayed(replayedModel);
+
+		if (journal.Replay(replayed) != 2 ||
+			replayed.GetCurrentState() != KEYBOARDSTATESExtended::CAPSLOCKED ||
+			replayedModel.GetKeyCount() != stateModel.GetKeyCount() ||
+			replayedModel.GetPressedKey() != 'q')
+			throw "Keyboard journal not replayed";
+		journal.Clear();
+	}
+
+	// A trigger that cannot be recorded is not given to the machine,
+	// so the journal still rebuilds it.
+	{
+		Journal<KEYBOARDTRIGGERS> closed;
+		KeyboardStateMachine unrecorded;
+		KEYBOARDSTATES before = unrecorded.GetCurrentState();
+		if (closed.Trigger(unrecorded, KEYBOARDTRIGGERS::DEFAULTENTRY) ||
+			unrecorded.GetCurrentState() != before)
+			throw "Trigger given to machine without a journal";
+
+		closed.Clear();
+		if (closed.GetSize() != 0 || closed.Flush() || closed.Replay(unrecorded) != -1)
+			throw "Closed journal not rejected";
+
+		remove(path);
+		Journal<KEYBOARDTRIGGERS> journal;
+		if (!journal.Open(path, 128))
+			throw "Journal not opened";
+		journal.SetMaxCapacity(256);
+
+		KeyboardStateMachine sm;
+		if (!journal.Trigger(sm, KEYBOARDTRIGGERS::DEFAULTENTRY))
+			throw "Trigger not recorded";
+
+		int accepted = 1;
+		while (journal.Trigger(sm, KEYBOARDTRIGGERS::CAPSLOCK))
+		{
+			if (++accepted > 256)
+				throw "Journal grew past its maximum capacity";
+		}
+
+		KEYBOARDSTATES full = sm.GetCurrentState();
+		if (journal.Trigger(sm, KEYBOARDTRIGGERS::CAPSLOCK) ||
+			sm.GetCurrentState() != full)
+			throw "Trigger given to machine by a full journal";
+
+		KeyboardStateMachine replayed;
+		if (journal.Replay(replayed) != accepted ||
+			replayed.GetCurrentState() != sm.GetCurrentState())
+			throw "Full journal not replayed";
+		journal.Clear();
+	}
+
+	// A trigger beyond the trigger enumeration marks the journal
+	// corrupt.
+	{
+		remove(path);
+		Journal<WIDETRIGGERS> wide;
+		if (!wide.Open(path) ||
+			!wide.Append(WIDETRIGGERS::DEFAULTENTRY) ||
+			!wide.Append((WIDETRIGGERS)KEYBOARDTRIGGERS::Count))
+			throw "Journal not opened";
+		wide.Close();
+
+		Journal<KEYBOARDTRIGGERS> journal;
+		if (!journal.Open(path))
+			throw "Journal not opened";
+
+		KeyboardStateMachine replayed;
+		if (journal.Replay(replayed) != -1)
+			throw "Corrupt journal replayed";
+		journal.Clear();
+	}
+
+	// Replay rate of a long journal.
+	{
+		const int eventCount = 10000000;
+
+		Journal<KEYBOARDTRIGGERS> journal;
+		if (!journal.Open(path))
+			throw "Journal not opened";
+
+		KeyboardStateMachine sm;
+		journal.Trigger(sm, KEYBOARDTRIGGERS::DEFAULTENTRY);
+		for (int i = 1; i < eventCount; i++)
+		{
+			journal.Trigger(sm, i % 3 == 0 ? KEYBOARDTRIGGERS::CAPSLOCK : KEYBOARDTRIGGERS::ANYKEY);
+		}
+
+		KeyboardStateMachine replayed;
+		auto start = std::chrono::steady_clock::now();
+		int64_t count = journal.Replay(replayed);
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+		if (count != eventCount || replayed.GetCurrentState() != sm.GetCurrentState())
+			throw "Journal not replayed";
+
+		printf("Journal replay: %lld million events per second, %llu bytes\n",
+			(long long)(eventCount / (elapsed.count() > 0 ? elapsed.count() : 1)),
+			(unsigned long long)journal.GetSize());
+	}
+
+	remove(path);
+}
+
+// Keyboard whose caps lock releases itself as soon as it is entered.
+class KeyboardFlatTriggerless : public FlatStateMachine<KeyboardFlatTriggerless,
+	KEYBOARDTRIGGERS,
+	(int)KEYBOARDTRIGGERS::Count,
+	KEYBOARDSTATES,
+	(int)KEYBOARDSTATES::Count,
+	KEYBOARDSTATES::DEFAULT>
+{
+public:
+	struct Definition;
+};
+
+struct KeyboardFlatTriggerless::Definition
+{
+	static constexpr FlatStateDescriptor<KeyboardFlatTriggerless, KEYBOARDSTATES> States[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT },
+		{ KEYBOARDSTATES::CAPSLOCKED, KEYBOARDSTATES::NOSTATE, KEYBOARDSTATES::NOSTATE, nullptr, nullptr, KEYBOARDSTATES::DEFAULT }
+	};
+
+	static constexpr FlatTransitionDescriptor<KeyboardFlatTriggerless, KEYBOARDTRIGGERS, KEYBOARDSTATES> Transitions[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT, KEYBOARDTRIGGERS::CAPSLOCK, nullptr, KEYBOARDSTATES::CAPSLOCKED }
+	};
+};
+
+template <class States, class Transitions>
+constexpr FlatDefinitionError ValidateKeyboard(const States& states, const Transitions& transitions)
+{
+	return ValidateFlatDefinition<(int)KEYBOARDTRIGGERS::Count, (int)KEYBOARDSTATES::Count>(
+		states, transitions, KEYBOARDSTATES::DEFAULT);
+}
+
+void TestFlatDefinitionValidation()
+{
+	typedef FlatStateDescriptor<KeyboardFlatStateMachine, KEYBOARDSTATES> StateDescriptor;
+	typedef FlatTransitionDescriptor<KeyboardFlatStateMachine, KEYBOARDTRIGGERS, KEYBOARDSTATES> TransitionDescriptor;
+
+	constexpr StateDescriptor states[] = { { KEYBOARDSTATES::DEFAULT }, { KEYBOARDSTATES::CAPSLOCKED } };
+	constexpr StateDescriptor duplicateStates[] = { { KEYBOARDSTATES::DEFAULT }, { KEYBOARDSTATES::DEFAULT } };
+	constexpr StateDescriptor loopStates[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT },
+		{ KEYBOARDSTATES::CAPSLOCKED, KEYBOARDSTATES::DEFAULT, KEYBOARDSTATES::NOSTATE }
+	};
+	constexpr StateDescriptor triggerlessLoopStates[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT, KEYBOARDSTATES::NOSTATE, KEYBOARDSTATES::NOSTATE, nullptr, nullptr, KEYBOARDSTATES::CAPSLOCKED },
+		{ KEYBOARDSTATES::CAPSLOCKED, KEYBOARDSTATES::NOSTATE, KEYBOARDSTATES::NOSTATE, nullptr, nullptr, KEYBOARDSTATES::DEFAULT }
+	};
+
+	constexpr TransitionDescriptor transitions[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT, KEYBOARDTRIGGERS::CAPSLOCK, nullptr, KEYBOARDSTATES::CAPSLOCKED }
+	};
+	constexpr TransitionDescriptor missingGuard[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT, KEYBOARDTRIGGERS::CAPSLOCK }
+	};
+	constexpr TransitionDescriptor unreachable[] =
+	{
+		{ KEYBOARDSTATES::DEFAULT, KEYBOARDTRIGGERS::ANYKEY, nullptr, KEYBOARDSTATES::DEFAULT }
+	};
+
+	static_assert(ValidateKeyboard(states, transitions) == FlatDefinitionError::None, "Valid definition rejected");
+	static_assert(ValidateKeyboard(duplicateStates, transitions) == FlatDefinitionError::DuplicateState, "Duplicate state accepted");
+	static_assert(ValidateKeyboard(loopStates, transitions) == FlatDefinitionError::MissingDefaultEntry, "Missing default entry accepted");
+	static_assert(ValidateKeyboard(triggerlessLoopStates, transitions) == FlatDefinitionError::TriggerlessLoop, "Triggerless loop accepted");
+	static_assert(ValidateKeyboard(states, missingGuard) == FlatDefinitionError::MissingGuard, "Missing guard accepted");
+	static_assert(ValidateKeyboard(states, unreachable) == FlatDefinitionError::UnreachableState, "Unreachable state accepted");
+
+	// Triggerless transitions run on entry, in a single machine and
+	// in a population.
+	KeyboardFlatTriggerless sm;
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Triggerless transition not taken";
+
+	FlatPopulation<KeyboardFlatTriggerless> population(16);
+	population.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	population.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (population.CountInState(KEYBOARDSTATES::DEFAULT) != 16)
+		throw "Triggerless transition not taken";
+}
+
+// S state chart recording the order of its entry and exit actions.
+class SFlatRecorder : public FlatStateMachine<SFlatRecorder,
+	STRIGGERS,
+	(int)STRIGGERS::Count,
+	SSTATES,
+	(int)SSTATES::Count,
+	SSTATES::S>
+{
+public:
+	struct Definition;
+
+	std::string Actions;
+
+	void EnterS() { Actions += "+S"; }
+	void EnterS1() { Actions += "+S1"; }
+	void EnterS11() { Actions += "+S11"; }
+	void EnterS2() { Actions += "+S2"; }
+	void EnterS21() { Actions += "+S21"; }
+	void ExitS() { Actions += "-S"; }
+	void ExitS1() { Actions += "-S1"; }
+	void ExitS11() { Actions += "-S11"; }
+	void ExitS2() { Actions += "-S2"; }
+	void ExitS21() { Actions += "-S21"; }
+};
+
+struct SFlatRecorder::Definition
+{
+	static constexpr FlatStateDescriptor<SFlatRecorder, SSTATES> States[] =
+	{
+		{ SSTATES::S, SSTATES::NOSTATE, SSTATES::S1, &SFlatRecorder::EnterS, &SFlatRecorder::ExitS },
+		{ SSTATES::S1, SSTATES::S, SSTATES::S11, &SFlatRecorder::EnterS1, &SFlatRecorder::ExitS1 },
+		{ SSTATES::S11, SSTATES::S1, SSTATES::NOSTATE, &SFlatRecorder::EnterS11, &SFlatRecorder::ExitS11 },
+		{ SSTATES::S2, SSTATES::S, SSTATES::S21, &SFlatRecorder::EnterS2, &SFlatRecorder::ExitS2 },
+		{ SSTATES::S21, SSTATES::S2, SSTATES::NOSTATE, &SFlatRecorder::EnterS21, &SFlatRecorder::ExitS21 }
+	};
+
+	static constexpr FlatTransitionDescriptor<SFlatRecorder, STRIGGERS, SSTATES> Transitions[] =
+	{
+		{ SSTATES::S11, STRIGGERS::T, nullptr, SSTATES::S2 },
+		{ SSTATES::S21, STRIGGERS::T, nullptr, SSTATES::S }
+	};
+};
+
+void TestFlatTransitionPaths()
+{
+	SFlatRecorder sm;
+
+	sm.Trigger(STRIGGERS::DEFAULTENTRY);
+	if (sm.Actions != "+S+S1+S11")
+		throw "Flat entry path not correct";
+
+	// Exits up to the common ancestor S, then enters the target and
+	// its default entry.
+	sm.Actions.clear();
+	sm.Trigger(STRIGGERS::T);
+	if (sm.Actions != "-S11-S1+S2+S21" || sm.GetCurrentState() != SSTATES::S21)
+		throw "Flat transition path not correct";
+
+	// A transition to the root leaves and re-enters the whole machine.
+	sm.Actions.clear();
+	sm.Trigger(STRIGGERS::T);
+	if (sm.Actions != "-S21-S2-S+S+S1+S11" || sm.GetCurrentState() != SSTATES::S11)
+		throw "Flat transition path not correct";
+}
+
+// Keyboard composite entered from a leaf sibling and left again on
+// TIMEOUT.
+class KeyboardHistoryComposite : public OrState<KeyboardHistoryComposite,
+	KEYBOARDTRIGGERS,
+	(int)KEYBOARDTRIGGERS::Count,
+	KEYBOARDSTATES,
+	(int)KEYBOARDSTATES::Count,
+	KEYBOARDSTATES::DEFAULT>
+{
+private:
+	void TimeoutTriggerGuard(KEYBOARDTRIGGERS trigger, Transition<KeyboardHistoryComposite, KEYBOARDSTATES>& transition)
+	{
+		transition.TargetState = KEYBOARDSTATES::DEFAULT;
+	}
+
+public:
+	CapsLocked* CapsLockedState;
+
+	KeyboardHistoryComposite()
+	{
+		CapsLockedState = new CapsLocked();
+		AddState(KEYBOARDSTATES::DEFAULT, new Default());
+		AddState(KEYBOARDSTATES::CAPSLOCKED, CapsLockedState);
+		AddTriggerGuard(KEYBOARDTRIGGERS::TIMEOUT, &KeyboardHistoryComposite::TimeoutTriggerGuard);
+	}
+};
+
+class KeyboardHistoryMachine : public OrState<KeyboardHistoryMachine,
+	KEYBOARDTRIGGERS,
+	(int)KEYBOARDTRIGGERS::Count,
+	KEYBOARDSTATES,
+	(int)KEYBOARDSTATES::Count,
+	KEYBOARDSTATES::DEFAULT>
+{
+public:
+	KeyboardHistoryComposite* Composite;
+
+	KeyboardHistoryMachine()
+	{
+		Composite = new KeyboardHistoryComposite();
+		AddState(KEYBOARDSTATES::DEFAULT, new Default());
+		AddState(KEYBOARDSTATES::CAPSLOCKED, Composite);
+	}
+};
+
+void TestHistory()
+{
+	KeyboardHistoryMachine sm;
+
+	// Without history the composite always enters its default state.
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.Composite->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Composite not in CAPSLOCKED";
+
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT ||
+		sm.Composite->GetHistoryState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Composite history not recorded";
+
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.Composite->GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Composite without history did not enter its default";
+
+	// Shallow history on the composite resumes its last child.
+	sm.Composite->SetHistory(HistoryKind::Shallow);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.Composite->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Shallow history not resumed";
+
+	// Shallow history on the root resumes the composite, which enters
+	// its own default when it has no history.
+	sm.Composite->SetHistory(HistoryKind::None);
+	sm.SetHistory(HistoryKind::Shallow);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTEXIT);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED ||
+		sm.Composite->GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Shallow history on the root not resumed";
+
+	// Deep history resumes the whole configuration.
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.SetHistory(HistoryKind::Deep);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTEXIT);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED ||
+		sm.Composite->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Deep history not resumed";
+
+	// A later default entry of the composite is not deep.
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.Composite->GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Deep history leaked into a default entry";
+
+	// History is part of a snapshot.
+	std::vector<unsigned char> buffer;
+	SnapshotWriter writer(buffer);
+	sm.Save(writer);
+
+	KeyboardHistoryMachine restored;
+	SnapshotReader reader(buffer.data(), buffer.size());
+	restored.Restore(reader);
+	if (!reader.IsValid() ||
+		restored.Composite->GetHistoryState() != KEYBOARDSTATES::CAPSLOCKED ||
+		restored.GetHistoryState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "History not restored";
+}
+
+// Keyboard machine that owns the queue its deferred triggers are
+// parked in.
+class KeyboardDeferringMachine : public OrState<KeyboardDeferringMachine,
+	KEYBOARDTRIGGERS,
+	(int)KEYBOARDTRIGGERS::Count,
+	KEYBOARDSTATES,
+	(int)KEYBOARDSTATES::Count,
+	KEYBOARDSTATES::DEFAULT>
+{
+public:
+	DeferredTriggerQueue<KEYBOARDTRIGGERS> Deferred;
+	Default* DefaultState;
+	KeyboardHistoryComposite* Composite;
+
+	KeyboardDeferringMachine() :
+		Deferred(2)
+	{
+		DefaultState = new Default();
+		Composite = new KeyboardHistoryComposite();
+		AddState(KEYBOARDSTATES::DEFAULT, DefaultState);
+		AddState(KEYBOARDSTATES::CAPSLOCKED, Composite);
+		SetDeferredQueue(&Deferred);
+	}
+};
+
+void TestDeferredTriggers()
+{
+	KeyboardDeferringMachine sm;
+	sm.DefaultState->AddDeferredTrigger(KEYBOARDTRIGGERS::TIMEOUT);
+
+	// A trigger with a guard is not deferred.
+	sm.DefaultState->AddDeferredTrigger(KEYBOARDTRIGGERS::ANYKEY);
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	sm.Trigger(KEYBOARDTRIGGERS::ANYKEY);
+	if (!sm.Deferred.IsEmpty())
+		throw "Guarded trigger deferred";
+
+	// TIMEOUT waits in DEFAULT and is handled by the composite once
+	// the machine has left DEFAULT.
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	if (sm.Deferred.GetCount() != 1 || sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Trigger not deferred";
+
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (!sm.Deferred.IsEmpty() || sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Deferred trigger not re-posted";
+
+	// A nested state deferring TIMEOUT hides it from the composite
+	// that has a guard for it.
+	sm.Composite->CapsLockedState->AddDeferredTrigger(KEYBOARDTRIGGERS::TIMEOUT);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	if (sm.Deferred.GetCount() != 1 || sm.GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED ||
+		sm.Composite->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Nested trigger not deferred";
+
+	// Leaving CAPSLOCKED within the composite re-posts it.
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (!sm.Deferred.IsEmpty() || sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Nested deferred trigger not re-posted";
+
+	// Triggers beyond the capacity of the ring are dropped.
+	for (int i = 0; i < 3; i++)
+	{
+		sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	}
+	if (sm.Deferred.GetCount() != 2 || sm.Deferred.GetDropped() != 1)
+		throw "Full deferred queue not handled";
+
+	// Both are re-posted and the first returns the machine to DEFAULT,
+	// where the second is deferred again.
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (sm.Deferred.GetCount() != 1 || sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Deferred triggers not re-posted in order";
+
+	// A composite deferring CAPSLOCK does not park it once its child
+	// has taken a transition for it.
+	KeyboardDeferringMachine consumed;
+	consumed.Composite->AddDeferredTrigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	consumed.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	consumed.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	consumed.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (!consumed.Deferred.IsEmpty() ||
+		consumed.Composite->GetCurrentState() != KEYBOARDSTATES::CAPSLOCKED)
+		throw "Consumed trigger deferred";
+
+	consumed.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	if (!consumed.Deferred.IsEmpty() ||
+		consumed.Composite->GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Consumed trigger re-posted";
+}
+
+// Stage of a pipeline that moves on to its next stage as soon as it
+// is entered.
+class PipelineStage : public StateTemplate<PipelineStage,
+	WIDETRIGGERS,
+	(int)WIDETRIGGERS::Count,
+	WIDESTATES,
+	0>
+{
+public:
+	WIDESTATES Next = WIDESTATES::NOSTATECHANGE;
+
+	void EntryAction(WIDESTATES& triggerless) override
+	{
+		triggerless = Next;
+	}
+};
+
+// Keeps the outcome of the last triggerless chain.
+struct PipelineTracePolicy : NullTracePolicy
+{
+	static int Hops;
+	static bool Stopped;
+
+	template <typename EnumState>
+	static void TriggerlessCompleted(const void*, EnumState, int hops)
+	{
+		Hops = hops;
+		Stopped = false;
+	}
+
+	template <typename EnumState>
+	static void TriggerlessStopped(const void*, EnumState, EnumState, int hops)
+	{
+		Hops = hops;
+		Stopped = true;
+	}
+};
+
+int PipelineTracePolicy::Hops = 0;
+bool PipelineTracePolicy::Stopped = false;
+
+class PipelineMachine : public OrState<PipelineMachine,
+	WIDETRIGGERS,
+	(int)WIDETRIGGERS::Count,
+	WIDESTATES,
+	(int)WIDESTATES::Count,
+	WIDESTATES::FIRST,
+	(int)WIDESTATES::Count,
+	0,
+	PipelineTracePolicy>
+{
+public:
+	PipelineStage* Stages[(int)WIDESTATES::Count];
+
+	PipelineMachine()
+	{
+		for (int i = 0; i < (int)WIDESTATES::Count; i++)
+		{
+			Stages[i] = new PipelineStage();
+			AddState((WIDESTATES)i, Stages[i]);
+		}
+	}
+};
+
+void TestTriggerlessChain()
+{
+	PipelineMachine sm;
+
+	// 150 stages run through on default entry.
+	for (int i = 0; i < 150; i++)
+	{
+		sm.Stages[i]->Next = (WIDESTATES)(i + 1);
+	}
+	sm.Trigger(WIDETRIGGERS::DEFAULTENTRY);
+	if (sm.GetCurrentState() != (WIDESTATES)150 ||
+		PipelineTracePolicy::Hops != 150 || PipelineTracePolicy::Stopped)
+		throw "Triggerless chain not completed";
+
+	// A chain that loops back stops before entering a state twice.
+	sm.Stages[150]->Next = (WIDESTATES)100;
+	sm.Trigger(WIDETRIGGERS::DEFAULTEXIT);
+	sm.Trigger(WIDETRIGGERS::DEFAULTENTRY);
+	if (sm.GetCurrentState() != (WIDESTATES)150 ||
+		PipelineTracePolicy::Hops != 150 || !PipelineTracePolicy::Stopped)
+		throw "Triggerless cycle not stopped";
+
+	// The hop limit stops a chain early.
+	sm.SetTriggerlessHopLimit(10);
+	sm.Trigger(WIDETRIGGERS::DEFAULTEXIT);
+	sm.Trigger(WIDETRIGGERS::DEFAULTENTRY);
+	if (sm.GetCurrentState() != (WIDESTATES)10 ||
+		PipelineTracePolicy::Hops != 10 || !PipelineTracePolicy::Stopped)
+		throw "Triggerless hop limit not applied";
+}
+
+void TestConstantTransitions()
+{
+	SimpleStateMachine sm;
+
+	sm.Trigger(TRIGGERS::DEFAULTENTRY);
+	sm.Trigger(TRIGGERS::IDLETRIGGER);
+	if (sm.GetCurrentState() != STATES::IDLE)
+		throw "Constant self transition not taken";
+
+	sm.Trigger(TRIGGERS::FINALTRIGGER);
+	if (sm.GetCurrentState() != STATES::FINAL)
+		throw "Constant transition not taken";
+
+	// FINAL has no transition for FINALTRIGGER.
+	sm.Trigger(TRIGGERS::FINALTRIGGER);
+	if (sm.GetCurrentState() != STATES::FINAL)
+		throw "Trigger without a transition not ignored";
+
+	sm.Trigger(TRIGGERS::IDLETRIGGER);
+	if (sm.GetCurrentState() != STATES::IDLE)
+		throw "Constant transition not taken";
+}
+
+void TestHandledTriggers()
+{
+	KeyboardHistoryMachine sm;
+	const unsigned char* handled = sm.GetHandledTriggers();
+
+	// The composite's TIMEOUT guard is collected by the root.
+	if (!IsTriggerHandled(handled, KEYBOARDTRIGGERS::CAPSLOCK) ||
+		!IsTriggerHandled(handled, KEYBOARDTRIGGERS::ANYKEY) ||
+		!IsTriggerHandled(handled, KEYBOARDTRIGGERS::TIMEOUT))
+		throw "Handled triggers not collected";
+
+	KeyboardStateMachine keyboard;
+	if (IsTriggerHandled(keyboard.GetHandledTriggers(), KEYBOARDTRIGGERS::TIMEOUT))
+		throw "Unhandled trigger in mask";
+
+	// TIMEOUT is ignored at the root and only reaches the composite.
+	sm.Trigger(KEYBOARDTRIGGERS::DEFAULTENTRY);
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Unhandled trigger changed state";
+
+	sm.Trigger(KEYBOARDTRIGGERS::CAPSLOCK);
+	sm.Trigger(KEYBOARDTRIGGERS::TIMEOUT);
+	if (sm.GetCurrentState() != KEYBOARDSTATES::DEFAULT)
+		throw "Composite guard skipped";
+
+	// A trigger deferred once the machine runs is added at once.
+	sm.Composite->CapsLockedState->AddDeferredTrigger(KEYBOARDTRIGGERS::TIMEOUT);
+	if (!IsTriggerHandled(sm.Composite->CapsLockedState->GetHandledTriggers(), KEYBOARDTRIGGERS::TIMEOUT))
+		throw "Handled trigger not added";
+
+	// S21, S2 and S do not handle T, which only S1 does.
+	S s;
+	s.SetReplayMode(true);
+	s.Trigger(STRIGGERS::DEFAULTENTRY);
+	s.Trigger(STRIGGERS::T);
+	s.Trigger(STRIGGERS::T);
+	if (s.GetCurrentState() != SSTATES::S2)
+		throw "Ignored trigger changed state";
 }
\ No newline at end of file